@@ -1,105 +1,448 @@
 #include <xc.h>
 #include "beetle.h"
 
+//********************* extern functions ***************************************
+// sensory
+extern void adc_scan(unsigned char);
+extern void adc_done(void);
+// motor control
+extern bit          motion(char, unsigned int, unsigned char, unsigned char);
+extern void         motion_clear(void);
+extern void         motion_next(void);
+extern void         motion_go(void);
+extern void         sing_next(void);
+extern unsigned int rand(rand_t);
+// main
+extern void         task_sense(void);
+extern void         task_react(void);
+extern void         task_ui(void);
+extern void         task_battery(void);
 
-bit Dbounce_us (volatile unsigned char *SFR, char BIT)
-// De-bounce a LOW->HIGH signal from voltage spikes <= a few microseconds wide,
-/*      by taking a closer look at bit 'BIT' of special function register 'SFR'
- *      to see whether it has been purposely set HIGH or triggered by noise.
- *      Assumes that if 'BIT' was set by noise, 'BIT' will not stay HIGH.
- *  Returns 0 if 'BIT' goes LOW.
- *  Returns 1 if 'BIT' remains consistently HIGH until TMR6 == PR6
+
+/* Motor acceleration ramp: PR2 for each half-step from standstill, at constant
+ *  acceleration from 1920 us (RAMP_START) to 1200 us (RAMP_TOP) per half-step
+ *  over 32 half-steps. Starting straight off at a short period would stall
+ *  the motors (minimum ~ 1150 us); deceleration runs back down the same ramp.
  */
-{   // abort if a separate debounce procedure is already happening
-    //  (it needs Timer6 to not be over-written)
-    if (Dbounce_in_progress == 1)
-    {   return 0;    }
-    
-    // set T6 interrupt (poll for flag)
-    TMR6IF = 0;    // clear flag
-    PR6 = 0xFF;    // no. of instruction cycles until interrupt after Timer6 ON;
-                   //  no more than 15360 i.e. motor interrupt frequency
-    GIEH = 0;      // disable interrupts to avoid distraction
-    T6CON = 0x04;  // prescaler 1; postscaler 1:1; Timer6 ON
-    
-    char ref = (unsigned)(1 << BIT);  // 'ref' points to the bit in question
-    while(1)    // 1 iteration == 13 instruction cycles (Microchip Xc8 compiler)
-    {
-        // if 'BIT' goes LOW:
-        if ((*SFR & ref) == 0)
-        {
-            T6CON = 0x00;   // Timer6 OFF & clear
-            TMR6 = 0x00;
-            GIEH = 1;       // re-enable interrupts
-            return 0;
-        }
-        // if 'BIT' remains HIGH for the duration of Timer6:
-        if (TMR6IF == 1)
-        {
-            T6CON = 0x00;   // Timer6 OFF & clear
-            TMR6 = 0x00;
-            GIEH = 1;       // re-enable interrupts
-            return 1;
+static const unsigned char RAMP[RAMP_TOP + 1] =
+{   192, 187, 183, 179, 176, 172, 169, 166, 163, 160, 157,
+    155, 153, 150, 148, 146, 144, 142, 140, 138, 137, 135,
+    133, 132, 130, 129, 128, 126, 125, 124, 122, 121, 120
+};
+
+/* Phase latches of M1 (m1ph1 & m1ph2) and M2 (m2ph1 & m2ph2) at each of the
+ *  four positions of the full-step cycle used in arcs (see 'arc()')
+ */
+static const unsigned char ARC_M1[4] = {0x08, 0x18, 0x10, 0x00};
+static const unsigned char ARC_M2[4] = {0x04, 0x44, 0x40, 0x00};
+
+
+/* Mainloop tasks (see 'main()'), in order of priority: 'run' is called when
+ *  the task is due. Times are in Timer0 counts of 4 us (256 to a 1.024 ms
+ *  tick): a task is due every 'period', and should take no longer than
+ *  'budget'.
+ */
+static const struct task
+{   void        (*run)(void);
+    unsigned int  period, budget;
+}   TASK[TASKS] =
+{   {task_sense,     256,  128},     // TASK_SENSE:   1 ms,  0.5 ms
+    {task_react,     256,  128},     // TASK_REACT:   1 ms,  0.5 ms
+    {task_ui,        256,   32},     // TASK_UI:      1 ms,  128 us
+    {task_battery, 16384,   32}      // TASK_BATTERY: 65 ms, 128 us
+};
+/* ...and how each is keeping to that: 'worst' is the longest it has taken so
+ *  far, 'overruns' how many times it went over budget, and 'late' how many
+ *  times it was kept waiting a whole period or more.
+ */
+static struct task_time
+{   unsigned int  due, start, worst;
+    unsigned char overruns, late;
+}   TASK_TIME[TASKS];
+// Timer0 overflows (1.024 ms ticks)
+static volatile unsigned char ticks = 0;
+
+/* Event ring: the interrupt routine is the only one to post, and mainloop the
+ *  only one to take, so neither needs to disable interrupts; each only ever
+ *  moves its own count ('event_in' & 'event_out'), and only once the event
+ *  itself has been written or read. 'events_lost' counts posts that found
+ *  the ring full.
+ */
+#define EVENTS 16           // (a power of 2)
+static struct event RING[EVENTS];
+static volatile unsigned char event_in = 0, event_out = 0;
+volatile unsigned char events_lost = 0;
+
+static unsigned int time_now(void)
+/* the time now, in Timer0 counts (4 us), with interrupts off */
+{
+    unsigned char t = ticks, l = TMR0L;
+    
+    if (TMR0IF == 1 && l < 0x80)    // overflowed, not counted yet
+    {   ++t;    }
+    return ((unsigned int)t << 8) | l;
+}
+
+unsigned int sched_time(void)
+/* the time now, in Timer0 counts (4 us) */
+{
+    unsigned int t;
+    
+    GIEH = 0;
+    t = time_now();
+    GIEH = 1;
+    return t;
+}
+
+void event_post(unsigned char type, unsigned char data)
+/* Post an event for mainloop (call from the interrupt routine only) */
+{
+    struct event *e;
+    
+    if ((unsigned char)(event_in - event_out) >= EVENTS)
+    {   if (events_lost != 0xFF)
+        {   ++events_lost;  }
+        return;
+    }
+    e = &RING[event_in & (EVENTS - 1)];
+    e->type = type;
+    e->data = data;
+    e->time = time_now();
+    ++event_in;     // (only now may mainloop take it)
+}
+
+bit event_get(struct event *e)
+/* Take the oldest event posted (call from mainloop only); 0 if there's none */
+{
+    if (event_out == event_in)
+    {   return 0;   }
+    *e = RING[event_out & (EVENTS - 1)];
+    ++event_out;    // (only now may the slot be posted to again)
+    return 1;
+}
+
+unsigned int bb_read(void)
+/* 'bb', in one piece (it's 2 bytes, and the T2 interrupt changes it) */
+{
+    unsigned int b;
+    
+    GIEH = 0;
+    b = bb;
+    GIEH = 1;
+    return b;
+}
+
+static bit task_due(unsigned char task)
+/* Is it time for 'task' to run? If so, start timing it */
+{
+    const struct task *T = &TASK[task];
+    struct task_time  *R = &TASK_TIME[task];
+    unsigned int       now = sched_time();
+    
+    if ((signed int)(now - R->due) < 0)
+    {   return 0;   }
+    if ((unsigned int)(now - R->due) >= T->period)
+    // a whole period (or more) late: count it, and start afresh from now
+    {   if (R->late != 0xFF)
+        {   ++R->late;  }
+        R->due = now + T->period;
+    }
+    else
+    {   R->due += T->period;    }
+    R->start = now;
+    return 1;
+}
+
+static void task_end(unsigned char task)
+/* 'task' has finished: check how long it took against its budget */
+{
+    struct task_time *R = &TASK_TIME[task];
+    unsigned int      run = sched_time() - R->start;
+    
+    if (run > R->worst)
+    {   R->worst = run; }
+    if (run > TASK[task].budget && R->overruns != 0xFF)
+    {   ++R->overruns;  }
+}
+
+void sched_run(void)
+/* One pass of the mainloop scheduler: run the first task that's due, in order
+ *  of priority. However long a task is kept waiting (by those above it, or
+ *  one that overran), 'due' is held to no more than a period behind: any
+ *  further, and 'task_due()' would come to see it as ahead.
+ */
+{
+    unsigned int  now = sched_time();
+    unsigned char i;
+    
+    for (i = 0; i < TASKS; i++)
+    {   if ((unsigned int)(TASK_TIME[i].due - now) > TASK[i].period &&
+            (unsigned int)(now - TASK_TIME[i].due) > TASK[i].period)
+        {   TASK_TIME[i].due = now - TASK[i].period;    }
+    }
+    for (i = 0; i < TASKS; i++)
+    {   if (task_due(i))
+        {   TASK[i].run();
+            task_end(i);
+            return;
         }
     }
-    // should never happen
+}
+
+
+/* Pushbutton debouncer: every button on PORTB at once, with a 2-bit counter
+ *  per button held "vertically" (bit 'i' of 'count_0' & 'count_1' is the
+ *  count for RB'i'). A button's count runs while it reads differently from
+ *  'buttons', and starts over whenever it reads the same again; after 4
+ *  samples in a row (~8 ms) that differ, 'buttons' takes the new level.
+ */
+static unsigned char count_0 = 0, count_1 = 0;
+
+static void buttons_sample(void)
+/* debounce another sample of PORTB (every other Timer0 tick), and post an
+ *  event for any button pressed or released; a master pushbutton pressed
+ *  posts every button held with it as well, for mainloop to go by (by the
+ *  time it takes the event, 'buttons' may have moved on)
+ */
+{
+    unsigned char delta, toggle;
+    
+    delta   = (PORTB & BUTTONS) ^ buttons;
+    count_1 = (count_1 ^ count_0) & delta;
+    count_0 = ~count_0 & delta;
+    toggle  = delta & ~(count_0 | count_1);     // counted round to 0
+    if (toggle == 0)
+    {   return; }
+    buttons ^= toggle;
+    if ((toggle & buttons) != 0)
+    {   event_post(EV_PRESS, toggle & buttons); }
+    if ((toggle & buttons & 0xC0) != 0)
+    {   event_post(EV_MASTER, buttons); }
+    if ((toggle & ~buttons) != 0)
+    {   event_post(EV_RELEASE, toggle & (unsigned char)~buttons);   }
+}
+
+
+unsigned char power_update(unsigned char level)
+/* Take a new battery level reading (see 'battery_sample()') and step the power
+ *  mode down, or back up, to suit; slow down and trim the motor current in
+ *  the lower modes. The reading is averaged over ~ 8 readings (~ 0.5 s) first,
+ *  so neither a spike nor the dip as the motors start gets through. Updates
+ *  'battery_soc', and returns the new 'power' mode.
+ */
+{
+    static const unsigned char BATT[POWER_OFF] = {BATT_SAVE, BATT_LOW, BATT_EMPTY};
+    static const unsigned char RAMP_MAX[POWER_OFF] = {18, 10, 4};
+    static unsigned int  filter = 0;    // average level x8
+    
+    if (filter == 0)
+    {   filter = (unsigned int)level << 3;  }
+    else
+    {   filter += level - (filter >> 3);    }
+    level = filter >> 3;
+    
+    if (level <= BATT_EMPTY)
+    {   battery_soc = 0;    }
+    else if (level >= BATT_FULL)
+    {   battery_soc = 100;  }
+    else
+    {   battery_soc = (unsigned char)((level - BATT_EMPTY) * 100 / (BATT_FULL - BATT_EMPTY));    }
+    
+    if (power == POWER_OFF)     // (there's no coming back from that)
+    {   return power;   }
+    while (power < POWER_OFF && level < BATT[power])
+    {   ++power;    }
+    while (power > POWER_FULL && power < POWER_OFF &&
+           level >= BATT[power - 1] + BATT_HYST)
+    {   --power;    }
+    
+    if (power < POWER_OFF)
+    {   ramp_top     = RAMP_MAX[power];         // (from the next half-step)
+        current_trim = (power == POWER_FULL)? 0x00 : 0x01;  // (next movement)
+    }
+    return power;
+}
+
+
+/* The collision event to react to (see 'react()') for each combination of one
+ *  bumper's 5 signals: STATE bits 0-4 (front), or 5-9 shifted down (rear),
+ *  i.e. right LDR, right PB, middle LDR, left PB, left LDR (mirrored at the
+ *  rear). A pushbutton outranks the LDRs; an LDR on one side alone steers the
+ *  pivot away from that side, anything else pivots at random.
+ */
+static const unsigned char EVENT[32] =
+{    0,  1,  2,  2,  4,  4,  2,  2,  8,  8,  2,  2,  8,  8,  2,  2,
+    16,  4,  2,  2,  4,  4,  2,  2,  8,  8,  2,  2,  8,  8,  2,  2
+};
+
+unsigned int state_event(unsigned int state)
+/* What STATE 'state' calls for, picked by which groups of event flags it has
+ *  set (see 'STATE_FRONT' etc.), most urgent first:
+ *  - signal 'done' + a hardware signal: REACT_HANG, a "hanging state"
+ *  - signal 'done' alone: REACT_DONE, continue or finish the reaction
+ *  - a front collision signal, or else a rear one: the event for 'react()'
+ *      ('EVENT[]' sorts out which of the bumper's 5 signals it is)
+ *  - a wheel stuck: 1024
+ *  - nothing else: 0
+ */
+{
+    if (state == STATE_DONE)
+    {   return REACT_DONE;  }
+    if ((state & STATE_DONE) != 0)
+    {   return REACT_HANG;  }
+    if ((state & STATE_FRONT) != 0)
+    {   return EVENT[state & STATE_FRONT];  }
+    if ((state & STATE_REAR) != 0)
+    {   return (unsigned int)EVENT[(state & STATE_REAR) >> 5] << 5;   }
+    if ((state & STATE_WHEEL) != 0)
+    {   return 1024;    }
     return 0;
 }
 
+void react(unsigned int event, char away)
+/* Queue the whole reaction to collision 'event' at once: after a ~500 ms
+ *  pause, 255 half-steps away from it in move() mode 'away' (2 reverse, 1
+ *  forward), then a pivot, then on forward until something else happens.
+ */
+{
+    unsigned int direction;
+    bit song;
+    
+    if (event == 16 || event == 512)        // LDR3, LDR6
+    {   direction = 'R';    }
+    else if (event == 1 || event == 32)     // LDR1, LDR4
+    {   direction = 'L';    }
+    else
+    {   direction = rand(RAND_DIRECTION);  }
+    
+    // nothing may take from the queue until the whole reaction is in it:
+    //  stop the movement in progress (motion_go() would drop it anyway),
+    //  and keep the end of the song from starting what's queued so far
+    TMR2IE = 0;
+    song   = CCP5IE;
+    CCP5IE = 0;
+    motion_clear();     // (e.g. the drive off after the start song)
+    motion(away, 255, 255, RAMP_TOP);
+    motion((direction == 'R')? 3 : 4, rand(RAND_DEGREE), 0, RAMP_TOP);
+    motion(1, 0, 0, RAMP_TOP);
+    motion_go();
+    CCP5IE = song;      // (after: if singing, the song's end starts it)
+}
+
 
 void interrupt T2 (void)
+/* (priority levels are disabled, so every interrupt source ends up here) */
 {
-    if(TMR2IF = 1)  // if TMR2 interrupt:
+    if (TMR2IE == 1 && TMR2IF == 1 && motion_delay != 0)
+    /* a queued movement is waiting to start (see 'motion()') */
+    {
+        TMR2IF = 0;
+        if (--motion_delay == 0)
+        {   IEN = 1;    }   // motor logic inverter on: go
+    }
+    
+    if (TMR2IE == 1 && TMR2IF == 1)  // if TMR2 interrupt:
     /* set up next half-step of motor square wave control */
     {       
         TMR2IF = 0; 
-        switch(aa)
-        {   case 0: L1 = 0;         
-                    m1ph1 = (M1 == 1)? 1 : 0;   // Ternary operators set phase
-                    m2ph1 = (M2 == 1)? 1 : 0;   // latches to appropriate values
-                    break;                      // depending on whether motors 
-            case 1: L0 = 0;                     // are supposed to be on or off
-                    break;          
-            case 2: L0 = 1;         
-                    m1ph2 = (M1 == 1)? b1_1 : 0;   
-                    m2ph2 = (M2 == 1)? b1_2 : 0;   
-                    break;          
-            case 3: L1 = 1;         
-                    break;          
-            case 4: L1 = 0;         
-                    m1ph1 = 0;      
-                    m2ph1 = 0;      
-                    break;          
-            case 5: L0 = 0;         
-                    break;          
-            case 6: L0 = 1;         
-                    m1ph2 = (M1 == 1)? b2_1 : 0;   
-                    m2ph2 = (M2 == 1)? b2_2 : 0;   
-                    break;          
-            case 7: L1 = 1;         
-                    break;    
-        }        
-        ++aa;
-        if(aa >= 8) // reset once every motor phase period  (i.e. 8 half-steps)
-        {   aa = 0; }
+        if (arcing == 1)
+        {   // M1 full step of an arc
+            arc_m1 = (arc_m1 + arc_dir) & 3;
+            LATA = (LATA & (unsigned char)~0x18) | ARC_M1[arc_m1];
+            odo_1 += step_1;
+        }
+        else
+        {   // all six motor driver latches at once, from the table move() made
+            LATA = (LATA & (unsigned char)~STEP_MASK) | STEP[aa];
+            odo_1 += step_1;
+            odo_2 += step_2;
+            // reset once every motor phase period  (i.e. 8 half-steps)
+            aa = (aa + 1) & 7;
+            
+            // accelerate up to 'cruise' (or 'ramp_top' if lower), and slow
+            //  down again in time to stop at 'bb_stop' (if there is one: 0
+            //  means keep going)
+            if (bb_stop != 0 && bb_stop - bb <= ramp)
+            {   if (ramp != 0)
+                {   --ramp; }
+            }
+            else if (ramp < ramp_top && ramp < cruise)
+            {   ++ramp; }
+            else if (ramp > ramp_top || ramp > cruise)  // lowered on the way
+            {   --ramp; }
+            PR2 = RAMP[ramp];   // TMR2 has just been cleared: takes effect now
+        }
                 
         ++bb;
-        if (bb == bb_stop) // end of a reaction
-        {   // effectively call 'move(0)'
-            TMR2IE = 0;
-            m1ph2 = 0;
-            m2ph2 = 0;
-            m1ph1 = 0;
-            m2ph1 = 0;
-            IEN = 0;   
-            L0 = 0;
-            L1 = 1;
+        if (bb == bb_stop) // end of a movement
+        {   // on to the next one queued, or stop
+            motion_next();
+            if (TMR2IE == 0)
+            {   event_post(EV_STOP, 0); }
         }
         
-        // call signal(mod. 6 & 7) from mainloop every 3 T2 interrupts
-        if (cc >= 3)
-        {   cc = 0; }
-        ++cc;
+        // sample the wheel rotation sensors (mod. 7 & 8) every 3 half-steps;
+        //  in an arc, every 3 half-steps of M1 (each full step is 2) for
+        //  mod. 7, and module 8 follows M2 (below)
+        if (arcing == 1)
+        {   cc += 2;
+            if (cc >= 3)
+            {   cc -= 3;
+                adc_scan(7);
+            }
+        }
+        else
+        {   ++cc;
+            if (cc >= 3)
+            {   cc = 0;
+                adc_scan(7);
+                adc_scan(8);
+            }
+        }
     }   
     
+    if (CCP4IE == 1 && CCP4IF == 1)  // if CCP4 (Timer3) interrupt:
+    /* M2 full step of an arc (see 'arc()') */
+    {
+        CCP4IF = 0;
+        arc_m2 = (arc_m2 + arc_dir) & 3;
+        LATA = (LATA & (unsigned char)~0x44) | ARC_M2[arc_m2];
+        odo_2 += step_2;
+        
+        dd += 2;
+        if (dd >= 3)
+        {   dd -= 3;
+            adc_scan(8);
+        }
+    }
+    
+    if (CCP5IE == 1 && CCP5IF == 1)  // if CCP5 (Timer5) interrupt:
+    /* next half-period of the song being sung (see 'sing()') */
+    {
+        CCP5IF = 0;
+        sing_next();
+    }
+    
+    if (TMR0IE == 1 && TMR0IF == 1)  // if TMR0 interrupt:
+    /* mainloop scheduler tick (every 1.024 ms) */
+    {
+        TMR0IF = 0;
+        ++ticks;
+        if ((ticks & 1) == 0)
+        {   buttons_sample();   }
+    }
+    
+    if (TMR4IE == 1 && TMR4IF == 1)  // if TMR4 interrupt:
+    /* time to sample the next collision detector module (every 520 us) */
+    {
+        TMR4IF = 0;
+        adc_scan(0);
+    }
+    
+    if (ADIE == 1 && ADIF == 1)      // if ADC interrupt:
+    /* a conversion has finished: store it and start the next */
+    {
+        ADIF = 0;
+        adc_done();
+    }
 }
\ No newline at end of file
@@ -2,66 +2,63 @@
 #include <xc.h>
 #include "beetle.h"
 
-void sing (const char song[])
-/* Vibrate the motors just for fun, and leave them in a stable OFF condition. */
+//********************* extern functions ***************************************
+// sensory
+extern void wheel_reset(void);
+
+
+/* The motion queue (see 'motion()'): movements wait here in order until the
+ *  T2 interrupt starts each one as soon as the last has finished.
+ *  'motion_in' & 'motion_out' count the movements queued & started.
+ */
+#define MOTION_QUEUE 4      // (a power of 2)
+static struct motion
+{   unsigned char mode;
+    unsigned int  steps;    // half-steps (0 = keep going); pivots: degrees
+    unsigned char delay;    // T2 interrupts (1920 us) to wait first
+    unsigned char speed;    // cruising speed: ramp position (0 - RAMP_TOP)
+}   QUEUE[MOTION_QUEUE];
+static volatile unsigned char motion_in = 0, motion_out = 0;
+// counts the movements started from the queue, and tells 'pivot_track()' that
+//  a pivot has just been started (by 'pivot()' or from the queue)
+static volatile unsigned char motion_seg = 0;
+static volatile bit pivot_fresh = 0;
+
+void motion_next(void);
+static unsigned int pivot_steps(unsigned int deg, unsigned int spd);
+
+/* Songs for 'sing()': each note is a half-period in us (the motors' phase 1
+ *  latches toggle that often) and a length in Timer5 overflows (65.5 ms);
+ *  a 0 half-period ends the song.
+ */
+static const struct note
+{   unsigned int  pitch;
+    unsigned char beats;
+}   SONG_ON[]    = {{473, 2}, {355, 2}, {237, 2}, {0, 0}},  // C  F  C'
+    SONG_OFF[]   = {{237, 2}, {355, 2}, {473, 3}, {0, 0}},  // C' F  C
+    SONG_START[] = {{355, 2}, {237, 3}, {0, 0}},            // F  C'
+    SONG_STOP[]  = {{237, 2}, {355, 3}, {0, 0}};            // C' F
+// (in the order of 'song_t')
+static const struct note *const SONGS[] =
+{   SONG_ON, SONG_OFF, SONG_START, SONG_STOP
+};
+// the note being sung, how many more Timer5 overflows it lasts, and when
+//  (TMR5) the phase 1 latches toggle next
+static const struct note *note;
+static volatile unsigned char beats;
+static unsigned int sing_at;
+
+void sing (song_t song)
+/* Vibrate the motors just for fun, and leave them in a stable OFF condition.
+ *  The song plays in the background, one half-period per CCP5 interrupt:
+ *  'singing' is set until it's over.
+ */
 {
-    unsigned char i = 0, ph_state = 0;
-    unsigned int j = 0;
+    if (song > SING_STOP)
+    {   return; }
+    note = SONGS[song];
     
-    // 'len_song' determines how many notes to play
-    unsigned char len_song;
-    // each element of 'song_pitch' is the number of microseconds in one period
-    //  of a desired wavelength
-    unsigned int song_pitch[7];
-    
-    // song options:
-    if (song == "on")
-    {
-        len_song = 6;
-        song_pitch[0] = 473; // C
-        song_pitch[1] = 473;
-        song_pitch[2] = 355; // F
-        song_pitch[3] = 355;
-        song_pitch[4] = 237; // C'
-        song_pitch[5] = 237;
-    }
-    else if (song == "off")
-    {
-        len_song = 7;
-        song_pitch[0] = 237; // C'
-        song_pitch[1] = 237;
-        song_pitch[2] = 355; // F
-        song_pitch[3] = 355;
-        song_pitch[4] = 473; // C
-        song_pitch[5] = 473;
-        song_pitch[6] = 473;
-    }
-    else if (song == "start")
-    {  
-        len_song = 5;
-        song_pitch[0] = 355; // F
-        song_pitch[1] = 355;
-        song_pitch[2] = 237; // C'
-        song_pitch[3] = 237;
-        song_pitch[4] = 237;
-        song_pitch[5] = 237;        
-    }
-    else if (song == "stop")
-    {
-        len_song = 5;
-        song_pitch[0] = 237; // C'
-        song_pitch[1] = 237;
-        song_pitch[2] = 355; // F
-        song_pitch[3] = 355;
-        song_pitch[4] = 355;
-        song_pitch[5] = 355;
-    }
-    
-    // init Timer5
-    TMR5IF = 0;
-    TMR5H = 0;
-    TMR5L = 0;
-    T5CON = 0b00110001;
+    CCP5IE = 0;
     
     // both motors at full voltage
     IEN = 0;
@@ -69,49 +66,115 @@ void sing (const char song[])
     L1 = 0;
     
     // keep phase2 constant and toggle phase1
+    m1ph1 = 0;
+    m2ph1 = 0;
     m1ph2 = 0;
     m2ph2 = 0;
     
-    for (i = 0; i < len_song; i++)
-    {
-        while(TMR5IF == 0) // each note lasts ~200 ms
-        {
-            for (j = 0; j < song_pitch[i]; j++)
-            {   __delay_us(1);  }
-            
-            if (ph_state == 0)
-            {
+    // init Timer5: 1 us ticks, overflow every 65.5 ms
+    T5CON = 0b00110000;     // timer5 (fosc/4); (presc. 8); (OFF)
+    TMR5H = 0;
+    TMR5L = 0;
+    TMR5IF = 0;
+    beats = note->beats;
+    
+    // CCP5 compare matches interrupt every half-period
+    CCPTMRS1bits.C5TSEL = 2;    // CCP5 capture/compare uses Timer5
+    sing_at = note->pitch;
+    CCPR5H  = sing_at >> 8;
+    CCPR5L  = sing_at & 0xFF;
+    CCP5CON = 0b00001010;   // compare mode: software interrupt only
+    CCP5IF  = 0;
+    
+    // go
+    singing = 1;
+    CCP5IE  = 1;
+    TMR5ON  = 1;
+}
+
+void sing_next(void)
+/* Next half-period of the song (called by the CCP5 interrupt) */
+{
+    m1ph1 = !m1ph1;
+    m2ph1 = m1ph1;
+    
+    if (TMR5IF == 1)
+    // another 65.5 ms gone: on to the next note?
+    {   TMR5IF = 0;
+        if (--beats == 0)
+        {   ++note;
+            if (note->pitch == 0)
+            // end of the song: leave the motors OFF
+            {   CCP5IE  = 0;
+                CCP5CON = 0x00;
+                T5CON   = 0x00;
                 m1ph1 = 0;
                 m2ph1 = 0;
-                ph_state = 1;
-            }
-            else
-            {
-                m1ph1 = 1;
-                m2ph1 = 1;
-                ph_state = 0;
+                m1ph2 = 0;
+                m2ph2 = 0;
+                L0 = 1;
+                L1 = 1;
+                singing = 0;
+                // start anything queued meanwhile
+                if (motion_out != motion_in)
+                {   motion_next();  }
+                return;
             }
+            beats = note->beats;
         }
-        TMR5IF = 0;
     }
-    //  clean up Timer5
-    TMR5L = 0;
-    TMR5H = 0;
-    T5CON = 0;
-    
-    // leave motors in OFF state
-    m1ph1 = 0;
-    m2ph1 = 0;
-    m1ph2 = 0;
-    m2ph2 = 0;
-    L0 = 1;
-    L1 = 1;
+    sing_at += note->pitch;
+    CCPR5H = sing_at >> 8;
+    CCPR5L = sing_at & 0xFF;
 }
 
+/* Motor latches (LATA) for each move() mode:
+ *  - 'ph1' holds the phase 1 latch of each motor that turns
+ *  - 'ph2_1' and 'ph2_2' hold the phase 2 latches that are HIGH in the first
+ *      and second half of the cycle respectively
+ *  ('m1ph1' = RA3, 'm2ph1' = RA2, 'm1ph2' = RA4, 'm2ph2' = RA6)
+ */
+static const struct phase
+{   unsigned char ph1, ph2_1, ph2_2;
+    signed char   step_1, step_2;   // M1 & M2 half-steps per T2 interrupt
+}   PHASE[9] =
+{   {0x00, 0x00, 0x00,  0,  0},     // 0: stop
+    {0x0C, 0x50, 0x00,  1,  1},     // 1: forward
+    {0x0C, 0x00, 0x50, -1, -1},     // 2: reverse
+    {0x0C, 0x10, 0x40,  1, -1},     // 3: pivot clockwise (m1 fwd; m2 rev)
+    {0x0C, 0x40, 0x10, -1,  1},     // 4: pivot anti-clockwise (m1 rev, m2 fwd)
+    {0x08, 0x10, 0x00,  1,  0},     // 5: turn forward right (m1 forward)
+    {0x04, 0x40, 0x00,  0,  1},     // 6: turn forward left (m2 forward)
+    {0x08, 0x00, 0x10, -1,  0},     // 7: turn backward right (m1 backward)
+    {0x04, 0x00, 0x40,  0, -1}      // 8: turn backward left (m2 backward)
+};
+/* Current limiting latches L0 (RA0) & L1 (RA1) for each half-step */
+static const unsigned char CURRENT[8] =
+{   0x01, 0x00, 0x01, 0x03, 0x01, 0x00, 0x01, 0x03
+};
 
-void move(char mode, const char when[])
+static void set_phase(unsigned char mode)
+/* build STEP[] and 'step_1' & 'step_2' for move() mode 'mode' */
+{
+    unsigned char i;
+    
+    if(mode <= 8)
+    {   step_1 = PHASE[mode].step_1;
+        step_2 = PHASE[mode].step_2;
+    }
+    if(mode >= 1 && mode <= 8)
+    {   for (i = 0; i < 8; i++)
+        {   STEP[i] = CURRENT[i] | current_trim |
+                      ((i < 4)? PHASE[mode].ph1 : 0) |
+                      ((i >= 2 && i < 6)? PHASE[mode].ph2_1 : PHASE[mode].ph2_2);
+        }
+    }
+}
+
+void move(char mode, unsigned int stop, when_t when)
 /* This function sets up the initial motor conditions for the desired movement;
- *  then the conditions are updated over time via Timer2 interrupt.
+ *  then the conditions are updated over time via Timer2 interrupt, until 'bb'
+ *  reaches 'stop' half-steps (0: until something else happens).
  * 
  *  mode "1" drives robot forward;
  *  mode "2" drives robot in reverse;
@@ -123,10 +186,37 @@ void move(char mode, const char when[])
  *  mode "8" turns robot backward to the left;
  *  mode "0" brings robot to a stop
  * 
- *  when[] "wait" delays the start of movement
- *  when[] "now" starts movement right away
+ *  when MOVE_WAIT delays the start of movement
+ *  when MOVE_NOW starts movement right away
  */
 {       
+    // hold the T2 interrupt off until everything it uses is set up (below)
+    TMR2IE  = 0;
+    // end any arc in progress: M2 goes back to Timer2 with M1
+    CCP4IE  = 0;
+    CCP4CON = 0x00;
+    T3CON   = 0x00;
+    arcing  = 0;
+    pivot_deg = 0;  // (and any pivot: 'pivot()' starts a new one after this)
+    // this movement replaces anything still queued
+    motion_out = motion_in;
+    motion_delay = 0;
+    cruise = RAMP_TOP;
+    
+    /*  *the phase 1 square wave of each motor that turns is HIGH for the first
+     *      4 half-steps of the cycle; phase 2 is HIGH in the first or second
+     *      half of the cycle (offset by 2 half-steps), and which of the two
+     *      determines stepper motor direction
+     *      --[forward and reverse options]
+     *  *a motor left out of 'ph1' has both phase inputs of its stepper motor
+     *      driver a constant LOW voltage level, causing it to hold still
+     *      --[stationary option]
+     *  *combinations of forward, reverse, and stationary options for motors
+     *      1 and 2 determine robot behavior in each mode.
+     *  The T2 interrupt copies STEP[aa] to the motor latches every half-step.
+     */
+    set_phase(mode);
+
     /* Timer2 on & set time interval
      * 
      *  *equations:   (assuming FOSC == 32 MHz)
@@ -145,15 +235,13 @@ void move(char mode, const char when[])
     TMR2IF = 0; // flag bit starts LOW
     TMR2IP = 0; // priority low
     
-    if (when == "now")
-    {   // interrupt period = 1920 us (i.e. 15360 cyc)
+    if (when == MOVE_NOW)
+    {   // interrupt period = 1920 us (i.e. 15360 cyc) to start with; the
+        //  T2 interrupt then accelerates up to 'ramp_top' (see 'RAMP[]')
         T2CON = 0b00100111;        //[presc. = 1:16]; [postsc. = 1:5]
-        PR2 = 0xC0;                // decimal '192'
-        // interrupt enabled
-        TMR2IE = 1;
-        IEN = 1;    // enable motor logic inverter
+        PR2 = RAMP_START;
     }
-    else // "wait":
+    else // MOVE_WAIT:
     {   // set motor conditions for a mode, but don't enable T2 interrupt:
         //  use T2 to wait ~500 ms (monitor TMR2IF & 'waiting' in mainloop);
         //  when done waiting, start interrupt
@@ -167,7 +255,9 @@ void move(char mode, const char when[])
     //initial iterator values
     aa = 0;
     bb = 1;
-    cc = 0;     // don't call signal(modules 6 & 7) while not in motion
+    bb_stop = stop;
+    ramp = 0;
+    cc = 0;     // wheel sensors are sampled every 3 half-steps from here
     
     //initial output values 
     m1ph2   = 0;
@@ -177,82 +267,7 @@ void move(char mode, const char when[])
     L0      = 1;
     L1      = 1;
     
-    /*  *variables b1, b2 determine the orientation of phase2 sq. wave, and
-     *      thus stepper motor direction  
-     *      --[forward and reverse options]
-     *  *option [Mx = 0] makes both phase inputs of stepper motor driver(x)
-     *      a constant LOW voltage level, causing motor(x) to hold still;
-     *      else if [Mx = 1], stepper motor rotates as planned
-     *      --[stationary option]
-     *  *combinations of forward, reverse, and stationary options for motors
-     *      1 and 2 determine robot behavior in each mode.
-     */
-    
-    if(mode == 1)          //forward
-    {   M1 = 1;
-        M2 = 1;
-        b1_1 = 1;
-        b1_2 = 1;
-        b2_1 = 0;
-        b2_2 = 0;
-    }
-    else if(mode == 2)     //reverse
-    {   M1 = 1;
-        M2 = 1;
-        b1_1 = 0;
-        b1_2 = 0;
-        b2_1 = 1;
-        b2_2 = 1;
-    }
-    else if(mode == 3)     //pivot clockwise (m1 forward; m2 reverse)
-    {   M1 = 1;
-        M2 = 1;
-        b1_1 = 1;
-        b1_2 = 0;
-        b2_1 = 0;
-        b2_2 = 1;
-    }
-    else if(mode == 4)     //pivot anti-clockwise (m1 reverse, m2 forward)
-    {   M1 = 1;
-        M2 = 1;
-        b1_1 = 0;
-        b1_2 = 1;
-        b2_1 = 1;
-        b2_2 = 0;
-    }    
-    else if(mode == 5)     //turn forward right (m1 forward, m2 stationary)
-    {   M1 = 1;
-        M2 = 0;
-        b1_1 = 1;
-        b1_2 = 0;
-        b2_1 = 0;
-        b2_2 = 0;
-    }
-    else if(mode == 6)     //turn forward left (m2 forward, m1 stationary)
-    {   M1 = 0;
-        M2 = 1;
-        b1_1 = 0;
-        b1_2 = 1;
-        b2_1 = 0;
-        b2_2 = 0;
-    }
-    else if(mode == 7)     //turn backward right (m1 backward, m2 stationary)
-    {   M1 = 1;
-        M2 = 0;
-        b1_1 = 0;
-        b1_2 = 0;
-        b2_1 = 1;
-        b2_2 = 0;
-    }
-    else if(mode == 8)     //turn backward left (m2 backward, m1 stationary)
-    {   M1 = 0;
-        M2 = 1;
-        b1_1 = 0;
-        b1_2 = 0;
-        b2_1 = 0;
-        b2_2 = 1;
-    }
-    else if(mode == 0)     //stop completely
+    if(mode == 0)          //stop completely
     {   TMR2ON = 0; // Timer2 off
         TMR2IE = 0; // Timer2 interrupt disabled    
         // phase outputs all zero
@@ -266,10 +281,282 @@ void move(char mode, const char when[])
         L0 = 1;
         L1 = 1;
     }
+    else if (when == MOVE_NOW)
+    {   // interrupt enabled
+        TMR2IE = 1;
+        IEN = 1;    // enable motor logic inverter
+    }
     // remember the previous movement
     prev_mode = mode;
 }
 
+#define ARC_SLOWEST 8160    // longest M1 full-step period, us (PR2 = 255)
+void arc(char mode, unsigned int period_1, unsigned int period_2,
+         unsigned int stop)
+/* Drive both motors forward (mode 1) or in reverse (mode 2), each at a rate of
+ *  its own, for a continuous arc whose radius depends on the ratio of the two:
+ *  'period_1' & 'period_2' are the M1 & M2 full-step periods in us, from
+ *  2300 (the motors' limit) to 8160. 'bb' counts M1 full steps, up to 'stop'
+ *  (0: until something else happens).
+ * 
+ *  The current limiting latches L0 & L1 are shared by both motors, so the
+ *      half-step sequence can't run for each at a different rate. Instead,
+ *      with the inverter off and L0 = L1 = 0 both phases of both motors get
+ *      100% current, and each motor is full-stepped by its phase latches
+ *      alone: from its own interrupt, M1 on Timer2 and M2 on Timer3/CCP4.
+ *  In the lower power modes L0 & L1 are trimmed as for the half-steps (see
+ *      'current_trim'), and with less current both periods are stretched,
+ *      by 1/8 (POWER_SAVE) or 1/4 (POWER_LOW), as 'ramp_top' is lowered;
+ *      M1 no slower than 8160 us, M2 in proportion, for the same radius.
+ */
+{
+    // slower in the lower power modes (see 'power_update()')
+    if (power < POWER_OFF)
+    {   period_1 += (period_1 >> 3) * power;
+        period_2 += (period_2 >> 3) * power;
+    }
+    if (period_1 > ARC_SLOWEST)
+    {   period_2 = (unsigned long)period_2 * ARC_SLOWEST / period_1;
+        period_1 = ARC_SLOWEST;
+    }
+    
+    TMR2IE = 0;
+    pivot_deg = 0;
+    
+    // carry on from (near enough) where the half-step sequence left off
+    arc_m1  = aa >> 1;
+    arc_m2  = aa >> 1;
+    arc_dir = (mode == 2)? 3 : 1;
+    step_1  = (mode == 2)? -2 : 2;  // one full step == 2 half-steps
+    step_2  = step_1;
+    
+    IEN = 0;    // inverter off...
+    L0  = current_trim & 0x01;          //  ...and 100% current (unless
+    L1  = (current_trim >> 1) & 0x01;   //  trimmed, see above)
+    
+    // M1: Timer2 interrupt period = (PR2 x 32) us
+    TMR2IF = 0;
+    T2CON  = 0b01111111;    //[presc. = 1:16]; [postsc. = 1:16]
+    PR2    = period_1 >> 5;
+    
+    // M2: CCP4 compare matches reset Timer3 (1 us ticks) every 'period_2'
+    CCP4IE   = 0;
+    CCPTMRS1bits.C4TSEL = 1;    // CCP4 capture/compare uses Timer3
+    T3CON    = 0b00110010;  // timer3 (fosc/4); (presc. 8); (16-bit); (OFF)
+    TMR3H    = 0;
+    TMR3L    = 0;
+    CCPR4H   = period_2 >> 8;
+    CCPR4L   = period_2 & 0xFF;
+    CCP4CON  = 0b00001011;  // compare mode: special event trigger
+    CCP4IF   = 0;
+    
+    //initial iterator values
+    bb = 1;
+    bb_stop = stop;
+    cc = 0;
+    dd = 0;
+    arcing = 1;
+    
+    // go
+    TMR2IE = 1;
+    CCP4IE = 1;
+    TMR3ON = 1;
+    
+    prev_mode = mode;
+}
+
+/*  MOTION QUEUE
+ * 
+ *  A reaction made of several movements (e.g. reverse, pivot, drive on) is
+ *      queued in one go with 'motion()', and 'motion_go()' starts it. From
+ *      then on the T2 interrupt runs each movement as soon as the one before
+ *      has reached its 'bb_stop', with no need for mainloop to step in.
+ */
+bit motion(char mode, unsigned int steps, unsigned char delay,
+           unsigned char speed)
+/* Queue move() mode 'mode' for 'steps' half-steps (0 = until something else
+ *  happens; modes 3 & 4 pivot 'steps' degrees), after 'delay' x 1920 us with
+ *  the motors off, cruising at 'speed' (no faster than 'ramp_top' allows).
+ *  Returns 0 if the queue is full.
+ */
+{
+    struct motion *next;
+    
+    if ((unsigned char)(motion_in - motion_out) >= MOTION_QUEUE)
+    {   return 0;   }
+    next = &QUEUE[motion_in & (MOTION_QUEUE - 1)];
+    next->mode  = mode;
+    next->steps = steps;
+    next->delay = delay;
+    next->speed = speed;
+    ++motion_in;    // (only now may the T2 interrupt take it)
+    return 1;
+}
+
+void motion_clear(void)
+/* Forget anything queued that hasn't started yet */
+{
+    GIEH = 0;   // (the T2 & CCP5 interrupts take from the queue)
+    motion_out = motion_in;
+    GIEH = 1;
+}
+
+void motion_next(void)
+/* Start the next queued movement, or stop if there is none
+ *  (called by the T2 interrupt at 'bb_stop', and by 'motion_go()')
+ */
+{
+    struct motion *next;
+    
+    // end any arc in progress
+    CCP4IE  = 0;
+    CCP4CON = 0x00;
+    T3CON   = 0x00;
+    arcing  = 0;
+    
+    if (motion_out == motion_in)
+    // nothing left to do: effectively call 'move(0)'
+    {   TMR2IE = 0;
+        m1ph2 = 0;
+        m2ph2 = 0;
+        m1ph1 = 0;
+        m2ph1 = 0;
+        IEN = 0;   
+        L0 = 0;
+        L1 = 1;
+        return;
+    }
+    next = &QUEUE[motion_out & (MOTION_QUEUE - 1)];
+    
+    set_phase(next->mode);
+    aa = 0;
+    bb = 1;
+    cc = 0;
+    ramp = 0;
+    cruise = next->speed;
+    if (next->mode == 3 || next->mode == 4)
+    {   pivot_deg = next->steps;
+        pivot_fresh = 1;
+        bb_stop = pivot_steps(pivot_deg, steps_per_deg);
+    }
+    else
+    {   bb_stop = next->steps;  }
+    prev_mode = next->mode;
+    
+    // motors off until the delay is over (see T2 interrupt)
+    motion_delay = next->delay;
+    m1ph2 = 0;
+    m2ph2 = 0;
+    m1ph1 = 0;
+    m2ph1 = 0;
+    L0    = 1;
+    L1    = 1;
+    IEN   = (motion_delay == 0)? 1 : 0;
+    
+    ++motion_seg;
+    ++motion_out;
+    
+    // interrupt period = 1920 us, accelerating from there (see 'RAMP[]')
+    T2CON  = 0b00100111;    //[presc. = 1:16]; [postsc. = 1:5]
+    PR2    = RAMP_START;
+    TMR2IE = 1;
+}
+
+void motion_go(void)
+/* Drop the movement in progress and start on the queue right away (or as
+ *  soon as 'sing()' has finished)
+ */
+{
+    TMR2IE  = 0;
+    waiting = 'n';
+    if (singing == 1)
+    {   return; }
+    motion_next();
+}
+
+bit motion_busy(void)
+/* 1 while queued movements are left to run, or the one in progress has a
+ *  'bb_stop' it hasn't reached yet
+ */
+{
+    bit busy;
+    
+    GIEH = 0;   // 'bb' & 'bb_stop' mustn't change halfway through reading them
+    busy = (motion_out != motion_in || (bb_stop != 0 && bb != bb_stop));
+    GIEH = 1;
+    return busy;
+}
+
+
+/*  DEAD RECKONING
+ * 
+ *  1 tire revolution == ~618 motor half-steps, and the wheel diameter is
+ *      144 mm; so each half-step of a wheel moves it 0.732 mm.
+ *  Moving one wheel by 's' turns the robot by (s / 145 mm) radians about the
+ *      other wheel, and moves its center by (s / 2).
+ * 
+ *  Per half-step of M1 (left) or M2 (right):
+ *      center of robot moves  (0.732 / 2) mm         == 375   (mm x1024)
+ *      heading changes        (0.732 / 145) radians  == 13480 (65536ths x256)
+ */
+#define ODO_MOVE 375        // mm x1024 per half-step, either wheel
+#define ODO_TURN 13480L     // 65536ths of a turn x256 per half-step
+
+// sin(0 - 90 degrees) x16384, in 64ths of a right angle
+static const signed int SINE[65] =
+{       0,   402,   804,  1205,  1606,  2006,  2404,  2801,  3196,  3590,
+     3981,  4370,  4756,  5139,  5520,  5897,  6270,  6639,  7005,  7366,
+     7723,  8076,  8423,  8765,  9102,  9434,  9760, 10080, 10394, 10702,
+    11003, 11297, 11585, 11866, 12140, 12406, 12665, 12916, 13160, 13395,
+    13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978, 15137, 15286,
+    15426, 15557, 15679, 15791, 15893, 15986, 16069, 16143, 16207, 16261,
+    16305, 16340, 16364, 16379, 16384
+};
+
+static signed int sine(unsigned int angle)
+/* sin('angle' in 65536ths of a turn) x16384, to the nearest 256th of a turn */
+{
+    unsigned char i = (angle >> 8) & 63;
+    
+    switch (angle >> 14)
+    {   case 0:  return  SINE[i];
+        case 1:  return  SINE[64 - i];
+        case 2:  return -SINE[i];
+        default: return -SINE[64 - i];
+    }
+}
+
+void odometry(void)
+/* Add the half-steps the motors have turned since last time to 'POSE'.
+ *  Call often enough that neither motor gets beyond 127 half-steps ahead
+ *  (a quarter of a second or so).
+ */
+{
+    static unsigned long heading = 0;   // 'POSE.heading' x256
+    signed char  d1, d2;
+    signed long  move;
+    unsigned int mid;
+    
+    // take the half-steps from the T2 & CCP4 interrupts
+    GIEH = 0;
+    d1 = odo_1;
+    d2 = odo_2;
+    odo_1 = 0;
+    odo_2 = 0;
+    GIEH = 1;
+    if (d1 == 0 && d2 == 0)
+    {   return; }
+    
+    // the robot moves along the heading halfway through the turn
+    mid = (unsigned int)((heading + (d2 - d1) * ODO_TURN / 2) >> 8);
+    heading += (d2 - d1) * ODO_TURN;
+    POSE.heading = (unsigned int)(heading >> 8);
+    
+    move = (signed long)(d1 + d2) * ODO_MOVE;  // mm x1024
+    POSE.x += (move * sine(mid + 16384) + 32768) >> 16;
+    POSE.y += (move * sine(mid) + 32768) >> 16;
+}
+
 /*  PRECISION PIVOT
  * 
  *  Given:
@@ -290,278 +577,199 @@ void move(char mode, const char when[])
  **************************
  *
  * N.B. this formula doesn't work, possibly due to too much imprecision in the
- *  mechanical structure. Actual values are chosen by trial & error:
+ *  mechanical structure. Values found by trial & error:
  * 
  * 45  degrees:     bb_stop ~ 120
  * 90  degrees:     bb_stop ~ 220
  * 135 degrees:     bb_stop ~ 315
  * 180 degrees:     bb_stop ~ 410
+ * 
+ *  i.e. about PIVOT_SLACK + 2.19 half-steps per degree, which is where
+ *  'steps_per_deg' starts out.
+ * 
+ *************************
+ * Rather than rely on it, each pivot is measured by the wheel rotation sensors
+ *  (modules 7 & 8): 'WHEELx' is the no. of half-steps per hex face the wheel
+ *  actually turns (x16), and one hex face is 1/6 of a wheel revolution, so
+ * 
+ *  half-steps per degree == (WHEELx / 16)*(6)*(145/144)/(360)
+ *                        == (WHEELx x 275 / 1024) / 256
+ * 
+ *  That is the formula above again, with the wheels' own half-steps per
+ *  revolution in place of 618, so on its own it still comes to ~ 1.73 for
+ *  wheels turning freely: what it misses is the wheels scrubbing round
+ *  (Beetle turns less than they do). The table above puts that at
+ *  2.19 / 1.73 ~ 1.27 (PIVOT_SCRUB), which is taken as it stands.
+ * 
+ *  As soon as a wheel has measured a hex face, the end of the pivot is moved
+ *  to suit; when the pivot is done, 'steps_per_deg' is moved 1/4 of the way
+ *  to the measured value for next time.
  */
+#define PIVOT_SLACK 20      // half-steps taken up before the wheels get going
+#define PIVOT_WHEEL 275     // 'WHEELx' to half-steps per degree x256, /1024
+#define PIVOT_SCRUB 324     // wheel turn per degree of pivot x256: 560 / 442
 
-void pivot(unsigned int direction, unsigned int degree)
-/* initialize a pivot movement */
+static unsigned int pivot_steps(unsigned int deg, unsigned int spd)
+/* the no. of half-steps that pivot 'deg' degrees at 'spd' half-steps/deg x256 */
+{
+    return PIVOT_SLACK + (unsigned int)(((unsigned long)deg * spd) >> 8);
+}
+
+static unsigned int pivot_measured(void)
+/* half-steps per degree x256 that the wheels have measured during this pivot
+ *  (0 if neither has yet)
+ */
+{
+    unsigned long wheel;
+    
+    if (WHEEL7 != 0 && WHEEL8 != 0)
+    {   wheel = ((unsigned long)WHEEL7 + WHEEL8) >> 1;  }
+    else
+    {   wheel = WHEEL7 + WHEEL8;    }
+    return (unsigned int)((((wheel * PIVOT_WHEEL) >> 10) * PIVOT_SCRUB) >> 8);
+}
+
+void pivot(unsigned int direction, unsigned int degree, when_t when)
+/* initialize a pivot movement of 'degree' degrees */
 {   
+    // continue pivoting until stopping point
+    unsigned int stop = pivot_steps(degree, steps_per_deg);
+    
     if (direction == 'R')       //clockwise
-    {   move(3, "wait");
+    {   move(3, stop, when);
     }
     else if (direction == 'L')  //anti-clockwise
-    {   move(4, "wait");
+    {   move(4, stop, when);
     }
-    // continue pivoting until stopping point
-    bb_stop = degree;
+    // measure this pivot from scratch (see 'pivot_track()')
+    pivot_fresh = 1;
+    pivot_deg = degree;
 } 
 
+void pivot_track(void)
+/* Follow the pivot in progress (call from mainloop) */
+{
+    static unsigned char seg;
+    unsigned int spd, stop;
+    
+    GIEH = 0;   // a queued pivot is started by the T2 interrupt
+    if (pivot_deg == 0)
+    {   GIEH = 1;
+        return;
+    }
+    if (pivot_fresh == 1)
+    // just started: measure it from scratch
+    {   pivot_fresh = 0;
+        seg = motion_seg;
+        GIEH = 1;
+        wheel_reset();
+        return;
+    }
+    GIEH = 1;
+    spd = pivot_measured();
+    
+    GIEH = 0;   // 'bb' & 'bb_stop' mustn't change halfway through reading them
+    if (bb == bb_stop || motion_seg != seg)
+    // finished (maybe with the next queued movement already under way):
+    //  remember how far the wheels turned per half-step
+    {   if (spd != 0)
+        {   steps_per_deg += ((signed int)spd - (signed int)steps_per_deg) / 4;
+        }
+        pivot_deg = 0;
+        GIEH = 1;
+        return;
+    }
+    if (spd != 0)
+    // stop where the wheels say 'pivot_deg' will have been reached
+    {   stop = pivot_steps(pivot_deg, spd);
+        bb_stop = (stop > bb)? stop : bb + 1;
+    }
+    GIEH = 1;
+}
+
 
-unsigned int rand(const char type[])
-/*  This function is a Pseudo-Random Bit Sequence generator, inspired by
- *      maximal-length feedback shift register electronics hardware.
- * 
- * HOW IT WORKS:
- *  The "shift" buffer is 15 bits; a maximal-length sequence is obtained by
- *      placing "feedback taps" on the 14th and 15th bits.  These are XOR-ed
- *      and the result 'D' overwrites the 1st bit.
- *     This results in 32,767 "unpredictable" 1s and 0s before it repeats.
- *     Instead of shifting all the elements every time, it is a circular buffer:
- *      'bitnum' points to the appropriate three bits, and an extra "spacer" bit
- *      exists which is overwritten by 'D'.
- *  Instead of constantly running on a clocked input, this generator only 
- *      outputs as many bits as needed per function call (specified by local
- *      variable 'j').
- *     Because of this, an initial 16-bit "seed" should be used to begin the
- *      sequence at an unpredictable value.
- *  When certain arguments are passed to the function, it returns an integer
- *      within a certain range.
- *     This is done by masking 'SHFTREG' first with a bitwise AND operation
- *      against a literal to set the maximum value, and then with a bitwise OR
- *      operation against a second literal to set the minimum value.
- *     The problem here is that some values within the desired range are made
- *      impossible since the bitwise OR requires that one or more bits is always
- *      '1'.
+/*  PSEUDO-RANDOM NUMBERS
  * 
- * USAGE:
- *  If 'type' == <"direction">, 'L' or 'R' is returned depending on the value of
- *      bit 'D'.
- *  If 'type' == <"move">, one of the integers (3, 4, 5, or 6) is returned
- *      depending on two bits of SHFTREG generated for that purpose.
- *  If 'type' == <"degree">, an integer consisting of the 9 LSB's of 'SHFTREG' 
- *      is returned (the 6th and 7th bits are always set).
- *  If 'type' == <"time">, an integer consisting of the 13 LSB's of 'SHFTREG' is
- *      returned (the 10th and 9th bits are always set).
- * 
- * NOTES:
- *  I originally developed two versions of this function to compare their
- *      efficiencies:
- *      1) uses a bit-field struct as the shift register, and 
- *      2) uses an array of chars as the shift register.
- *     Ultimately, version "2" produced less assembly code; however, it took
- *      up more space in Data Memory.
- *     Version "1" proved more convenient to add further functionality to, as I 
- *      have done; bitwise masking couldn't be done with version "2".
- *     Both functions had similar cycle counts when tested in original bare-
- *      bones form.
+ *  'SHFTREG' steps through all 65535 non-zero 16-bit values as a xorshift
+ *      generator (shifts 7, 9 and 8): three shift-and-XORs make a whole new
+ *      word, where the old shift register made one bit at a time.
+ *  'rand_seed()' stirs in noise from the LDR ADC conversions at start-up and
+ *      the timing of each master pushbutton press (see 'main()'), so no two
+ *      runs wander the same way.
+ *  A range is mapped onto without bias by masking a new word down to the
+ *      smallest power of 2 that covers it, and trying again with the next
+ *      word if it lands beyond the range; so every value in the range turns
+ *      up equally often (no bits forced on or off).
  */
-{    
-/*  V.1 -- USING A BIT-FIELD STRUCT AS THE SHIFT REGISTER:
- *  (SHFTREG and SHFTREGbits are declared in 'beetle.h'; SHFTREG is initialized
- *   to '0' in 'main.c')
- */    
-    unsigned char i, j;
-    static unsigned char bitnum = 0;
-    static char D;
+unsigned int rand_word(void)
+/* step 'SHFTREG' on and return it */
+{
+    unsigned int x = SHFTREG;
     
     // SEED: initialize pseudo-random decision sequence with Timer1 counter
     //  (this timer drives the signal LEDs and its counter could be anywhere
     //   between 0x0 and 0xFFFF)
-    if (SHFTREG == 0)   // prevent all zeros or we're "stuck" (0^0 = 0)
-    {   if (TMR1L == 0 && TMR1H == 0)
-        {   SHFTREG = 0xFF;}    // if all else fails, just bring everything HIGH
-        else
-        {   SHFTREG = (unsigned)(TMR1L|(TMR1H << 8));}
+    if (x == 0)     // prevent all zeros or we're "stuck" (0 stays 0)
+    {   x = (unsigned)(TMR1L|(TMR1H << 8));
+        if (x == 0)
+        {   x = 0xFF;   }   // if all else fails, just bring everything HIGH
     }
+    x ^= x << 7;
+    x ^= x >> 9;
+    x ^= x << 8;
+    SHFTREG = x;
+    return x;
+}
+
+void rand_seed(unsigned int noise)
+/* stir 'noise' (e.g. ADC LSBs, timer jitter) into 'SHFTREG' */
+{
+    SHFTREG ^= noise;
+    rand_word();    // (0 is re-seeded from Timer1 here)
+    rand_word();
+}
+
+unsigned int rand_range(unsigned int low, unsigned int high)
+/* a random integer from 'low' to 'high' (inclusive), all equally likely */
+{
+    unsigned int span = high - low, mask = span, x;
     
-    // Determine how many new bits of SHFTREG to generate
-    if (type == "direction")
-    {   j = 1;  }
-    else if (type == "move")
-    {   j = 3;  }
-    else if (type == "degree" || type == "time")
-    {   j = 15;  }  // refresh 'SHFTREG'
-    
-    // Generate 'j' bits
-    for (i = 0; i < j; i++)
-    {
-        // increment
-        bitnum++;
-        if (bitnum >= 16)
-        {   bitnum = 0;
-        }        
-        switch(bitnum)  // navigate the circular buffer
-        {
-            case 0: D = (unsigned)(SHFTREGbits.b ^ SHFTREGbits.c);
-                SHFTREGbits.a = (unsigned)D;
-                break;
-            case 1: D = (unsigned)(SHFTREGbits.c ^ SHFTREGbits.d);
-                SHFTREGbits.b = (unsigned)D;
-                break;
-            case 2: D = (unsigned)(SHFTREGbits.d ^ SHFTREGbits.e);
-                SHFTREGbits.c = (unsigned)D;
-                break;
-            case 3: D = (unsigned)(SHFTREGbits.e ^ SHFTREGbits.f);
-                SHFTREGbits.d = (unsigned)D;
-                break;
-            case 4: D = (unsigned)(SHFTREGbits.f ^ SHFTREGbits.g);
-                SHFTREGbits.e = (unsigned)D;
-                break;
-            case 5: D = (unsigned)(SHFTREGbits.g ^ SHFTREGbits.h);
-                SHFTREGbits.f = (unsigned)D;
-                break;
-            case 6: D = (unsigned)(SHFTREGbits.h ^ SHFTREGbits.i);
-                SHFTREGbits.g = (unsigned)D;
-                break;
-            case 7: D = (unsigned)(SHFTREGbits.i ^ SHFTREGbits.j);
-                SHFTREGbits.h = (unsigned)D;
-                break;
-            case 8: D = (unsigned)(SHFTREGbits.j ^ SHFTREGbits.k);
-                SHFTREGbits.i = (unsigned)D;
-                break;
-            case 9: D = (unsigned)(SHFTREGbits.k ^ SHFTREGbits.l);
-                SHFTREGbits.j = (unsigned)D;
-                break;
-            case 10: D = (unsigned)(SHFTREGbits.l ^ SHFTREGbits.m);
-                SHFTREGbits.k = (unsigned)D;
-                break;
-            case 11: D = (unsigned)(SHFTREGbits.m ^ SHFTREGbits.n);
-                SHFTREGbits.l = (unsigned)D;
-                break;
-            case 12: D = (unsigned)(SHFTREGbits.n ^ SHFTREGbits.o);
-                SHFTREGbits.m = (unsigned)D;
-                break;
-            case 13: D = (unsigned)(SHFTREGbits.o ^ SHFTREGbits.p);
-                SHFTREGbits.n = (unsigned)D;
-                break;
-            case 14: D = (unsigned)(SHFTREGbits.p ^ SHFTREGbits.a);
-                SHFTREGbits.o = (unsigned)D;
-                break;
-            case 15: D = (unsigned)(SHFTREGbits.a ^ SHFTREGbits.b);
-                SHFTREGbits.p = (unsigned)D;
-                break;
-            default:
-                break;  // shouldn't happen
-        }
-    }
-    // Return the desired random literal
-    if (type == "direction")
-        /* return 'L' or 'R' randomly */
-    {
-        // bit 0 means RIGHT TURN; bit 1 means LEFT TURN
-        if (D == 0)
-        {   return 'R'; }
-        else
-        {   return 'L'; }
-    }
-    else if (type == "degree")
-        /* return a random integer between and including 192 and 511 */
-    {
-        if (SHFTREGbits.i == 0)
-        {   return ((SHFTREG & 0x01FF) | 0x00C0);   }
-        else
-        {   return (SHFTREG & 0x01FF);  }
-    }
-    else if (type == "move")
-        /* return ('move' parameters) 3, 4, 5, or 6 randomly */
+    // all ones from the top bit of 'span' down
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    // (counting from 1: 'rand_word()' is never 0, so it's all ones that
+    //  turns up once less in each period, and that's turned away unless
+    //  'span' is all ones itself; masking 0 would make 'low' 1 in 8 less
+    //  likely for RAND_TIME)
+    do
+    {   x = (rand_word() - 1) & mask;   }
+    while (x > span);   // (less than 1 in 2 words are turned away)
+    return low + x;
+}
+
+unsigned int rand(rand_t type)
+/*  If 'type' == <RAND_DIRECTION>, 'L' or 'R' is returned.
+ *  If 'type' == <RAND_MOVE>, one of the integers (3, 4, 5, or 6) is returned.
+ *  If 'type' == <RAND_DEGREE>, an integer between 80 and 207 (degrees of
+ *      pivot) is returned.
+ *  If 'type' == <RAND_TIME>, an integer between 1536 and 8191 (half-steps of
+ *      driving before a random turn) is returned.
+ */
+{
+    switch (type)
     {
-        unsigned int shftreg_temp = SHFTREG;
-        unsigned char randnum;
-        if (bitnum > 1)
-        {   shftreg_temp >> (bitnum - 1);
-        }
-        else if (bitnum == 0)
-        {   shftreg_temp >> 14;
-        }
-        // (if bitnum == 1, shftreg_temp can stay as is)
-        // At this point, 'shftreg_temp' bits 0 & 1 have been newly generated
-        
-        randnum = (shftreg_temp & 0x0003);  // i.e. randnum = 0, 1, 2, or 3
-        switch (randnum)
-        {
-            case 0:
-                return 3;   // pivot clkws
-            case 1:
-                return 4;   // pivot cntrclkws
-            case 2:
-                return 5;   // turn right
-            case 3:
-                return 6;   // turn left
-            default:
-                return 0; // shouldn't happen
-        }
+        case RAND_DIRECTION:
+            // bit 0 means RIGHT TURN; bit 1 means LEFT TURN
+            return ((rand_word() & 0x8000) == 0)? 'R' : 'L';
+        case RAND_MOVE:
+            return rand_range(3, 6);        // pivot or turn (see 'main()')
+        case RAND_DEGREE:
+            return rand_range(80, 207);
+        case RAND_TIME:
+            return rand_range(1536, 8191);
+        default:
+            return 0;   // shouldn't happen
     }
-    else if (type == "time")
-        /* return a random integer between and including 1536 and 8191 */
-    {
-        if (SHFTREGbits.l == 0)
-        {   return ((SHFTREG & 0x1FFF) | 0x0600);   }
-        else
-        {   return (SHFTREG & 0x1FFF);  }
-    }        
-    else
-        /* shouldn't happen */
-    {   return 0;   }
-    
-    
- /* V.2 -- USING AN ARRAY AS THE SHIFT REGISTER:
-  */  
-//    unsigned char SHIFT[16] = {0};  //buffer array of 16 chars (put this
-//                                      outside the function)
-//    static char D;
-//    
-//    // INCREMENT (i.e. shift the register)
-//    D++;
-//    if (D >= 16)
-//    {   D = 0;}    
-//    
-//    //**************************************************************************
-//    // SEED: initialize pseudo-random decision sequence with Timer1 counter 
-//    //  (this timer drives the signal LEDs and its counter could be anywhere
-//    //   between 0 and 65535)
-//    // (Ideally this segment of code only runs once)
-//    
-//        // prevent all zeros or we're "stuck" (0^0 = 0)
-//    if (   SHIFT[0]  == 0 && SHIFT[1]  == 0 && SHIFT[2]  == 0 && SHIFT[3]  == 0
-//        && SHIFT[4]  == 0 && SHIFT[5]  == 0 && SHIFT[6]  == 0 && SHIFT[7]  == 0
-//        && SHIFT[8]  == 0 && SHIFT[9]  == 0 && SHIFT[10] == 0 && SHIFT[11] == 0
-//        && SHIFT[12] == 0 && SHIFT[13] == 0 && SHIFT[14] == 0 && SHIFT[15] == 0
-//       )    
-//    {   unsigned char jj;
-//        // if all else fails, just bring all 'SHIFT' elements HIGH:
-//        if (TMR1L == 0 && TMR1H == 0)
-//        {   for( jj = 0; jj <= 15; jj++) 
-//            {   SHIFT[jj] = 1;
-//            }
-//        }
-//        // 'SHIFT[] = {TMR1L(0), TMR1L(1), ... TMR1H(7)}'
-//        else
-//        {   unsigned int tmrcntr = (unsigned)(TMR1L|(TMR1H << 8));
-//            // for all 'SHIFT' elements:
-//            for (jj = 0; jj <= 15; jj++)    
-//            {       // find out whether bit 'jj' of 'tmrcntr' is 1 or 0
-//                if ((tmrcntr & ((unsigned int)1 << jj)) == 0)
-//                    // and overwrite accordingly
-//                {   SHIFT[jj] = 0;}
-//                else
-//                {   SHIFT[jj] = 1;}
-//            }
-//        }
-//    }//*************************************************************************
-//    
-//    // XOR the feedback taps, and overwrite 'D' with the result
-//    unsigned char m = SHIFT[(unsigned)(D + 1)];
-//    unsigned char n = SHIFT[(unsigned)(D + 2)];    
-//    SHIFT[D] = (unsigned)(m ^ n);    
-//    
-//    // bit 0 means RIGHT TURN; bit 1 means LEFT TURN
-//    if (SHIFT[D] == 0)
-//    {   return 'R';}
-//    else
-//    {   return 'L';}  
-}
\ No newline at end of file
+}
@@ -2,6 +2,11 @@
 #include <xc.h>
 #include "beetle.h"
 
+//********************* extern functions ***************************************
+// main
+extern void event_post(unsigned char, unsigned char);
+extern unsigned int bb_read(void);
+
 /*  LIGHT DEPENDENT RESISTOR (LDR) SENSORS:
  * 
  * < Modules 1, 2, 3, 4, 5, 6 (collision detectors)>
@@ -31,19 +36,271 @@
  *      assumed that the wheel is rotating unhampered by outside objects.
  */
 
+//************** static variables for signal() -- initialized only once ********
+/* - 'adc_sample' is one ADC result, stamped with TMR1 (1 us ticks) and the
+ *      state of the signal LED's at the moment the conversion finished
+ * - each result is the average of 2^ADC_OVERSAMPLE back to back conversions
+ *      (a boxcar filter), which takes the edge off single noisy samples.
+ *      One conversion is 6 Tad acquisition + 11 Tad + 2 Tad discharge, plus
+ *      the ADC interrupt: ~ 25 us. The Timer4 slot is 520 us, and a pair of
+ *      wheel sensor results is asked for every 3 motor half-steps (5.8 ms),
+ *      so up to 2^4 (~ 400 us per result) keeps the scanner ahead.
+ */
+#define ADC_RING 4      // results queued per module (a power of 2)
+#ifndef ADC_OVERSAMPLE
+#define ADC_OVERSAMPLE 2    // 4 conversions per result (0 to 4)
+#endif
+
+/* - everything the ADC scanner does to the hardware, one macro each. A build
+ *      that replays recorded or synthetic traces through 'adc_scan()',
+ *      'adc_done()' and 'signal()' (e.g. on a PC, see host/adc.h) can define
+ *      any of them itself.
+ */
+#ifndef ADC_RESULT
+#define ADC_RESULT()    (((unsigned int)ADRESH << 8) | ADRESL)
+#endif
+#ifndef ADC_TIME        // (reading TMR1L latches TMR1H)
+#define ADC_TIME(t)     do { t = TMR1L; t |= (unsigned int)TMR1H << 8; } while (0)
+#endif
+#ifndef ADC_LED
+#define ADC_LED()       (PORTCbits.RC1)         // CCP2 output
+#endif
+#ifndef ADC_CHANNEL
+#define ADC_CHANNEL(c)  (ADCON0bits.CHS = (c))
+#endif
+#ifndef ADC_GO          // (acquisition time, 6 Tad, is added by hardware)
+#define ADC_GO()        (GO_nDONE = 1)
+#endif
+#ifndef ADC_BUSY
+#define ADC_BUSY()      (GO_nDONE == 1)
+#endif
+#ifndef ADC_SCANNING    // the scanner is running (see 'start_signal()')
+#define ADC_SCANNING()  (ADIE == 1)
+#endif
+struct adc_sample
+{   unsigned int  value;
+    unsigned int  time;
+    unsigned char led;
+};
+
+/* - 'SPNTS_WINDOW' is the number of gradients either side of 'MID' that are
+ *      summed into 'SLOPE'; up to 16 fit in 'GRDNT'
+ */
+#define SPNTS_WINDOW 10
+
+/* - 'LDRSIG' keeps the only two Light Dependent Resistor potential divider
+ *      SIGnal values the stationary point search reads back: the previous
+ *      sample (for the newest gradient), and the level logged with each
+ *      stationary point. The latter is the sample taken when 'MID' is 1,
+ *      which is what element [11] of the old 21 sample circular queue held.
+ */
+struct ldrsig
+{   unsigned int last;  // previous sample
+    unsigned int held;  // sample taken when 'MID' was last 1
+};
+
+/* - 'GRDNT' holds the last 2 x SPNTS_WINDOW gradients between LDRSIG samples
+ *      as two bit planes, newest in bit 0: a gradient of 1 sets its bit in
+ *      'pos', -1 sets its bit in 'neg', and 0 sets neither
+ */
+struct grdnt
+{   unsigned long pos;
+    unsigned long neg;
+};
+#define GRDNT_MID (1UL << (SPNTS_WINDOW - 1))      // crossing 'MID' this call
+#define GRDNT_OLD (1UL << (2 * SPNTS_WINDOW - 1))  // leaving the window
+
+/* - 'CAL' (collision detectors only) sets how sure the stationary point search
+ *      must be before it reports a signal, according to how noisy the
+ *      module is: 'noise' is the average difference between successive
+ *      samples, taken over blocks of CAL_SAMPLES samples.
+ *  'start_signal()' begins with a calibration phase, the first block, which
+ *      sets 'noise' outright; after that, 'noise' moves 1/2^CAL_ADAPT of the
+ *      way to each new block's average. Blocks in which a signal is
+ *      detected are thrown away, so a reflection doesn't count as noise.
+ *  The noisier the module, the weaker the slopes either side of a stationary
+ *      point may be ('slope' is lowered, to no less than SPNTS_SLOPE_MIN),
+ *      and the larger a wave has to be to count as a signal ('floor').
+ */
+#define SPNTS_SLOPE     5   // 'SLOPE' beyond +/- this marks a stationary point
+#define SPNTS_SLOPE_MIN 3   //  ... on the noisiest modules
+#define CAL_SAMPLES     64  // samples per block (~ 200 ms; a multiple of 16)
+#define CAL_ADAPT       3   // 'noise' follows new blocks over ~ 2^3 blocks
+#define CAL_SLOPE       5   // 'slope' is lowered by 1 per 2^CAL_SLOPE of 'noise'
+#define CAL_FLOOR       12  // 'floor' = CAL_FLOOR x 'noise'
+struct calib
+{   unsigned int  sum;      // sum of the differences in this block so far
+    unsigned int  noise;    // average difference between samples (Q4)
+    unsigned int  floor;    // smallest SIGNAL reported
+    signed char   slope;    // 'SLOPE' threshold for a stationary point
+    unsigned char samples;  // samples still to come in this block
+    unsigned char blocks;   // blocks averaged so far (stops counting at 1)
+};
+
+/* - array 'SPNTS' logs any Stationary PoiNTS (peaks and troughs)
+ *      discovered in LDRSIG data
+ */
+struct spnts
+{	unsigned int v_level; // digital voltage value
+    char         count;   // no. of counts since the previous stationary point
+};
+
+/* - 'SLOPE' keeps running totals of the GRDNT elements either side of 'MID';
+ *      they are updated as each gradient enters the window, crosses 'MID',
+ *      or leaves the window, instead of being added up again every call
+ */
+struct slope
+{   signed char L;  // sum of the SPNTS_WINDOW gradients older than 'MID'
+    signed char R;  // sum of the SPNTS_WINDOW gradients newer than 'MID'
+};
+
+#if DETECTOR == DETECT_TONE
+/* - 'TONE' (collision detectors only) holds two Goertzel filters tuned to the
+ *      LED frequency. Each module is sampled every 3.12 ms (6 x 520 us), so
+ *      one LED period is 42 samples and the LED lands exactly in bin 1 of a
+ *      42 sample block. The two filters run half a block apart, so a fresh
+ *      result is ready every 21 samples.
+ *  The filters are fed the difference between successive samples, which
+ *      takes out the ambient light level and any slow drift in it.
+ */
+#define TONE_N      42      // samples per block (one LED period)
+#define TONE_COEFF  16201   // 2cos(2pi/42)  (Q13)
+#define TONE_COS    8101    //  cos(2pi/42)  (Q13)
+#define TONE_SIN    1221    //  sin(2pi/42)  (Q13)
+#define TONE_MIN    8       // smallest wave (peak to peak) taken as a signal
+struct tone
+{   signed long   s1[2], s2[2];  // last two outputs of each filter
+    unsigned int  last;          // previous sample
+    unsigned char n;             // position in the block (0 to TONE_N-1)
+    unsigned char ready;         // bit 'f' set once filter 'f' has had a clean
+                                 //  start, i.e. its results can be trusted
+};
+#endif
+
+#if DETECTOR == DETECT_LOCKIN
+/* - 'LOCKIN' (collision detectors only) averages the samples taken while the
+ *      signal LED's are on and while they are off, over whole LED periods;
+ *      the difference is the light reflected back from an object, with the
+ *      ambient light cancelled out.
+ *  Samples taken in the first half of each LED half-period are skipped, to
+ *      give the photoresistor time to settle after the LED switches.
+ */
+#define LOCKIN_PERIODS 2        // LED periods per result (~ 262 ms)
+#define LOCKIN_SETTLE  0x8000   // TMR1 count after each LED edge (~ 33 ms)
+#define LOCKIN_MIN     6        // smallest on/off difference taken as a signal
+struct lockin
+{   unsigned int  on, off;      // sums of settled samples with LED on/off
+    unsigned char n_on, n_off;  // number of samples in each sum
+    unsigned char periods;      // LED periods summed so far (0 = not started)
+    unsigned char led;          // LED state at the previous sample
+};
+#endif
+
+/* - the wheel speed estimate is built from the spacing of stationary points in
+ *      the wheel rotation sensor data: each is half a hex face (1/12 rev.)
+ *      from the last. The wheel sensors are sampled every 3 half-steps, so
+ *      a wheel turning freely gives ~ 618/12/3 = 17.2 samples per half face.
+ */
+#define WHEEL_NOMINAL  275      // 17.2 samples per half face (Q4)
+
+/* For every photosensor module, there exists one 'struct module' holding:
+ * 
+ * - 'count' is an indication of the length of time between data points
+ * - 'MID' counts 0 to 2 x SPNTS_WINDOW, one step per sample, and is the
+ *      phase at which 'LDRSIG.held' is taken
+ * - 'LDRSIG', 'GRDNT', 'SPNTS', 'SLOPE', 'CAL' (and 'TONE' or 'LOCKIN')
+ *      as above
+ * - 'interval' (wheel sensors only) is the filtered spacing of stationary
+ *      points, in samples (Q4); 0 until the first one has been measured
+ * - circular queue 'RING' holds new ADC results for the module, left by the
+ *      ADC interrupt until 'signal()' gets around to them
+ */
+struct module
+{   unsigned int  count;
+    signed char   MID;
+    struct ldrsig LDRSIG;
+    struct grdnt  GRDNT;
+    struct spnts  SPNTS[2];
+    struct slope  SLOPE;
+    struct calib  CAL;
+    unsigned int  interval;
+#if DETECTOR == DETECT_TONE
+    struct tone   TONE;
+#elif DETECTOR == DETECT_LOCKIN
+    struct lockin LOCKIN;
+#endif
+    volatile struct adc_sample RING[ADC_RING];
+    volatile unsigned char     head;   // next RING slot the ADC fills
+    unsigned char              tail;   // next RING slot 'signal()' reads
+};
+static struct module MODULE[8];
+
+/* One descriptor per photosensor module, indexed by 'module_no - 1':
+ *  the ADC channel it is wired to, the 'LDRx' result it drives, whether it
+ *  is a wheel rotation sensor (and if so, the 'WHEELx' speed estimate it
+ *  drives), and its state.
+ */
+static const struct descriptor
+{   unsigned char  channel;
+    unsigned int  *SIGNAL;
+    unsigned char  wheel;
+    unsigned int  *WHEEL;
+    struct module *state;
+}   DESCRIPTOR[] =
+{   {0x0E, &LDR1, 0, 0,       &MODULE[0]},    // front right
+    {0x0F, &LDR2, 0, 0,       &MODULE[1]},    // front middle
+    {0x10, &LDR3, 0, 0,       &MODULE[2]},    // front left
+    {0x11, &LDR4, 0, 0,       &MODULE[3]},    // back left
+    {0x12, &LDR5, 0, 0,       &MODULE[4]},    // back middle
+    {0x13, &LDR6, 0, 0,       &MODULE[5]},    // back right
+    {0x04, &LDR7, 1, &WHEEL7, &MODULE[6]},    // M1 wheel
+    {0x0D, &LDR8, 1, &WHEEL8, &MODULE[7]}     // M2 wheel
+};
+#define MODULES (sizeof(DESCRIPTOR) / sizeof(DESCRIPTOR[0]))
+
+/* ADC scanner: bit 'i' of 'adc_pending' asks for a conversion of module
+ *  'i + 1', and 'adc_battery' for one of the battery level indicator;
+ *  'adc_busy' is the module being converted right now (0 = idle,
+ *  ADC_BATTERY = the battery)
+ */
+static volatile unsigned char adc_pending = 0, adc_busy = 0;
+static volatile bit           adc_battery = 0;
+#define ADC_BATTERY   (MODULES + 1)
+#define BATTERY_CHS   0x09      // AN9 (pin RB3): battery level indicator
+static void adc_start(void);
+void start_signal_poll(void);
+static unsigned char          adc_next_module = 0;  // round robin, modules 1-6
+static unsigned int           adc_sum = 0;  // conversions summed so far, and
+static unsigned char          adc_n   = 0;  //  how many, for 'adc_busy'
+static bit                    starting = 0; // waiting out an LED period
+//******************************************************************************
+
 void start_signal(void)
-{
 /* startup sequence for CCP2 sq. wave output to pin RC1 (signal LED's)
- *  (duty cycle 50%; freq. 7.6295 Hz) 
- */     
+ *  (duty cycle 50%; freq. 7.6295 Hz); the rest waits one period, for
+ *  'start_signal_poll()'
+ */
+{
     TRISC1 = 1;     //disable output pin temporarily
     CCPTMRS0 = 0x00;        //CCP2 capture/compare uses Timer1
     T1CON = 0b00110011;     //timer1 (fosc/4); (presc. 8); (16-bit); (ON).
     CCP2CON = 0b00000010;   //compare mode: toggle output on match
     CCPR2L = 0x00;    //}this number doesn't matter since TMR1 is not cleared
     CCPR2H = 0x00;    //}   upon TMR1-CCPR2 match
-    while(TMR1IF == 0)      //wait one period
-    {;}
+    starting = 1;
+    start_signal_poll();    // (Timer1 may have run a period already)
+}
+
+void start_signal_poll(void)
+/* Finish 'start_signal()' once Timer1 has run one period: call from the
+ *  mainloop (see TASK_SENSE) rather than wait ~ 65 ms for it
+ */
+{
+    unsigned char i;
+    
+    if (starting == 0 || TMR1IF == 0)
+    {   return; }
+    starting = 0;
     TRISC1 = 0;     //enable output pin 
     
 /* preparation for signal detection */
@@ -52,288 +309,532 @@ void start_signal(void)
     ADCON2 = 0b10011010;    //right justified; ACQT = 6 Tad; clock = Fosc/32
                             //  (Tad = 1 us)
     ADCON1 = 0x00;          //Vref+ = Vdd;   Vref- = Vss
+    ADON = 1;
+    adc_pending = 0;
+    adc_busy = 0;
+    ADIF = 0;
+    ADIE = 1;               // conversion results collected by interrupt
     
     // CONFIGURE Timer4****************************
-    // interrupt flag set every (PR4 * presc. * postsc.) = 4160 instruction
-    //  cycles  (i.e. 520 us  @ 32 MHz)
+    // interrupt every (PR4 * presc. * postsc.) = 4160 instruction cycles
+    //  (i.e. 520 us  @ 32 MHz); each one starts a conversion for the next
+    //  collision detector module
     PR4 = 0x68;             // PR4 = decimal '104'
     T4CON = 0b01001101;     // presc. 4, postsc. 10, timer4 on
     TMR4IF = 0;             // ensure flag bit is clear    
+    TMR4IE = 1;
+    
+    // calibrate the collision detector modules afresh, each window starting
+    //  from its middle; the first sample only gives the starting point for
+    //  the differences
+    for (i = 0; i < MODULES; i++)
+    {   MODULE[i].MID         = SPNTS_WINDOW;
+        MODULE[i].CAL.sum     = 0;
+        MODULE[i].CAL.floor   = 0;
+        MODULE[i].CAL.slope   = SPNTS_SLOPE;
+        MODULE[i].CAL.samples = CAL_SAMPLES + 1;
+        MODULE[i].CAL.blocks  = 0;
+    }
+    
+#if DETECTOR == DETECT_TONE
+    // discard any filter blocks left over from the last time
+    for (i = 0; i < MODULES; i++)
+    {   MODULE[i].TONE.ready = 0;    }
+#elif DETECTOR == DETECT_LOCKIN
+    // discard any sums left over from the last time
+    for (i = 0; i < MODULES; i++)
+    {   MODULE[i].LOCKIN.periods = 0;    }
+#endif
+}
+
+void signal_gate(void)
+/* Fewer signal LED pulses in the lower power modes: call every ~ 65 ms (about
+ *  an LED half-period, see TASK_BATTERY). Out of every 16 calls the LED's
+ *  are driven for 16 (POWER_FULL), 12 (POWER_SAVE) or 8 (POWER_LOW), and held
+ *  off for the rest; collisions are only seen while they're driven.
+ */
+{
+    static const unsigned char ON[POWER_OFF] = {16, 12, 8};
+    static unsigned char tick = 0;
+#if DETECTOR == DETECT_LOCKIN
+    unsigned char i;
+#endif
+    
+    if (!ADC_SCANNING() || power >= POWER_OFF)  // (not started, or stopped)
+    {   return; }
+    tick = (tick + 1) & 15;
+    if (tick < ON[power])
+    {   if (CCP2CON == 0x00)
+        {   CCP2CON = 0b00000010;   }   // compare mode: toggle output on match
+    }
+    else if (CCP2CON != 0x00)
+    {   CCP2CON = 0x00;     // RC1 back to its latch: LED's off
+        LATC1 = 0;
+#if DETECTOR == DETECT_LOCKIN
+        // no LED-on edges to close the lock-in sums while they're held off
+        //  (up to 8 calls, and the 'off' sum would overflow): start them
+        //  over once the LED's come back
+        for (i = 0; i < MODULES; i++)
+        {   MODULE[i].LOCKIN.periods = 0;    }
+#endif
+    }
 }
 
 void stop_signal(void)
 /* Clear all the timers & output latches used by 'signal()' */
 {
+    starting = 0;
     T1CON = 0x00;
     TMR1IF = 0;
+    TMR4IE = 0;
     T4CON = 0x00;
     TMR4IF = 0;
+    ADIE = 0;
+    ADON = 0;
+    ADIF = 0;
     CCP2CON = 0x00;
     LATC1 = 0;    
 }
 
 
-//************** static variables for signal() -- initialized only once ********
-/* For every photosensor module, there exists one of each following variable:
- * 
- * - 'count' is an indication of the length of time between data points
- * - 'MID' tracks the midpoint (and reference point) of circular queue 'LDRSIG'
- * - array 'LDRSIG' accumulates data points from Light Dependent Resistor
- *      potential divider SIGnal, via ADC converter
- * - array 'GRDNT' elements are 1, 0, or -1 depending on the gradient between
- *      'LDRSIG' elements
+unsigned int adc_noise(void)
+/* Fold the least significant bits of 16 conversions, across all 8 modules,
+ *  into one word for seeding 'rand()'. Waits for each conversion, so only
+ *  call it while the scanner isn't running (see 'start_signal()').
  */
-static unsigned int
-    count1 = 0, count2 = 0, count3 = 0, count4 = 0, count5 = 0, count6 = 0,
-    count7 = 0, count8 = 0,
-    LDRSIG1[21] = {0}, LDRSIG2[21] = {0}, LDRSIG3[21] = {0}, LDRSIG4[21] = {0},
-    LDRSIG5[21] = {0}, LDRSIG6[21] = {0}, LDRSIG7[21] = {0}, LDRSIG8[21] = {0};
-static signed char
-    MID1 = 10,  MID2 = 10,  MID3 = 10,  MID4 = 10,  MID5 = 10,  MID6 = 10,
-    MID7 = 10, MID8 = 10,
-    GRDNT1[21] = {0}, GRDNT2[21] = {0}, GRDNT3[21] = {0}, GRDNT4[21] = {0},
-    GRDNT5[21] = {0}, GRDNT6[21] = {0}, GRDNT7[21] = {0}, GRDNT8[21] = {0};
+{
+    unsigned char i;
+    unsigned int  noise = 0;
+    
+    if (ADC_SCANNING())
+    {   return 0;   }
+    ADCON2 = 0b10011010;    //right justified; ACQT = 6 Tad; clock = Fosc/32
+    ADCON1 = 0x00;          //Vref+ = Vdd;   Vref- = Vss
+    ADON = 1;
+    for (i = 0; i < 16; i++)
+    {   ADC_CHANNEL(DESCRIPTOR[i % MODULES].channel);
+        ADC_GO();
+        while (ADC_BUSY())
+        {;}
+        // (rotate so each conversion's noisy LSBs land on fresh bits)
+        noise = ((noise << 3) | (noise >> 13)) ^ (unsigned char)ADC_RESULT();
+    }
+    ADON = 0;
+    ADIF = 0;
+    return noise;
+}
 
-/* - array 'SPNTS' logs any Stationary PoiNTS (peaks and troughs)
- *      discovered in LDRSIG data
+
+bit battery_sample(unsigned char *level)
+/* Measure the battery level indicator on pin RB3, in ADC counts / 4 (~ 19.5 mV
+ *  each). While the scanner is running, the conversion is only asked for,
+ *  and fitted in between the photosensors: the level arrives later as an
+ *  EV_BATTERY event, and this returns 0. Otherwise it converts right away
+ *  (1 << ADC_OVERSAMPLE conversions, ~ 80 us; interrupts left on), puts the
+ *  level in '*level' and returns 1.
  */
-static struct spnts
-{	unsigned int v_level; // digital voltage value
-    char         count;   // no. of counts since the previous stationary point
-}   SPNTS1[2] = {0}, SPNTS2[2] = {0}, SPNTS3[2] = {0}, SPNTS4[2] = {0},
-    SPNTS5[2] = {0}, SPNTS6[2] = {0}, SPNTS7[2] = {0}, SPNTS8[2] = {0};
-//******************************************************************************
+{
+    unsigned char i;
+    unsigned int  sum = 0;
+    
+    if (ADC_SCANNING())
+    {   GIEH = 0;   // (the scanner is driven by the interrupts)
+        adc_battery = 1;
+        if (adc_busy == 0)
+        {   adc_start();    }
+        GIEH = 1;
+        return 0;
+    }
+    ADCON2 = 0b10011010;    //right justified; ACQT = 6 Tad; clock = Fosc/32
+    ADCON1 = 0x00;          //Vref+ = Vdd;   Vref- = Vss
+    ADC_CHANNEL(BATTERY_CHS);
+    ADON = 1;
+    for (i = 0; i < (1 << ADC_OVERSAMPLE); i++)
+    {   ADC_GO();
+        while (ADC_BUSY())
+        {;}
+        sum += ADC_RESULT();
+    }
+    ADON = 0;
+    ADIF = 0;
+    *level = (unsigned char)(sum >> (ADC_OVERSAMPLE + 2));
+    return 1;
+}
 
-void signal(unsigned char module_no)
-/*  'module_no' (1, 2, 3, 4, 5, 6, 7, or 8) specifies which photosensor
- *      module to analyze.  A meaningless value for 'module_no' does nothing.
- * <collision detectors> (mod. 1-6)
- *  [~ 3 milliseconds (or 6 TMR4IF events) per module]
- * This function, when called ~every 520 microseconds, evaluates the data from
- *  photosensor modules 1-6 via the ADC module (registers ADRESH:ADRESL) 
- *  searching for a frequency of 7.6295 Hz.  As long as it cannot be found,
- *  SIGNAL = 0; when the target frequency is consistently apparent, SIGNAL
- *  equals a value indicating its strength.
- * <wheel rotation sensors> (mod. 7, 8)
- *  [~ 5.8 milliseconds (or 3 Timer2 interrupts) per module]
- * Similar process to 'collision detectors.'  A consistent 'SIGNAL == 1' means
- *  the wheels are turning.
+
+//************** ADC scanner (called from the interrupt routine) ***************
+/* The ADC runs in the background: Timer4 and Timer2 interrupts ask for
+ *  conversions, and the ADC interrupt files each result in its module's
+ *  'RING' and starts the next one asked for. 'signal()' never waits for it.
+ */
+static void adc_start(void)
+/* start a conversion for the lowest numbered module waiting for one */
+{
+    unsigned char i;
+    
+    for (i = 0; i < MODULES; i++)
+    {   if ((adc_pending & (1 << i)) != 0)
+        {   adc_pending &= (unsigned char)~(1 << i);
+            adc_busy = i + 1;
+            adc_sum  = 0;
+            adc_n    = 0;
+            ADC_CHANNEL(DESCRIPTOR[i].channel);
+            ADC_GO();
+            return;
+        }
+    }
+    // the battery waits behind the photosensors
+    if (adc_battery == 1)
+    {   adc_battery = 0;
+        adc_busy = ADC_BATTERY;
+        adc_sum  = 0;
+        adc_n    = 0;
+        ADC_CHANNEL(BATTERY_CHS);
+        ADC_GO();
+        return;
+    }
+    adc_busy = 0;
+}
+
+void adc_scan(unsigned char module_no)
+/* ask for a conversion of module 'module_no' (1-8), or with 'module_no' == 0,
+ *  of the next collision detector module in turn
+ */
+{
+    if (!ADC_SCANNING())
+    {   return;     }
+    
+    if (module_no == 0)
+    {   do
+        {   ++adc_next_module;
+            if (adc_next_module > MODULES)
+            {   adc_next_module = 1;  }
+        }   while (DESCRIPTOR[adc_next_module - 1].wheel == 1);
+        module_no = adc_next_module;
+    }
+    adc_pending |= (unsigned char)(1 << (module_no - 1));
+    
+    if (adc_busy == 0)
+    {   adc_start();    }
+}
+
+void adc_done(void)
+/* add up the finished conversion; once there are 2^ADC_OVERSAMPLE of them,
+ *  file the average and start the next module's
+ */
+{
+    struct module *m;
+    unsigned char  h;
+    unsigned int   t;
+    
+    adc_sum += ADC_RESULT();
+    if (++adc_n < (1 << ADC_OVERSAMPLE))
+    {   ADC_GO();       // same channel again
+        return;
+    }
+    
+    if (adc_busy == ADC_BATTERY)
+    // hand the battery level to mainloop in 8 bits: ADC counts / 4
+    {   event_post(EV_BATTERY, (unsigned char)(adc_sum >> (ADC_OVERSAMPLE + 2)));
+        adc_start();
+        return;
+    }
+    
+    m = DESCRIPTOR[adc_busy - 1].state;
+    h = m->head;
+    ADC_TIME(t);
+#if ADC_OVERSAMPLE == 0
+    m->RING[h].value = adc_sum;
+#else
+    m->RING[h].value = (adc_sum + (1 << (ADC_OVERSAMPLE - 1))) >> ADC_OVERSAMPLE;
+#endif
+    m->RING[h].time  = t;
+    m->RING[h].led   = ADC_LED();
+    
+    // if 'signal()' has fallen behind by a whole RING, this result is lost
+    h = (h + 1) & (ADC_RING - 1);
+    if (h != m->tail)
+    {   m->head = h;    }
+    event_post(EV_ADC, adc_busy);
+    
+    adc_start();
+}
+
+
+#if DETECTOR == DETECT_TONE
+static void tone(const struct descriptor *module,
+                 const struct adc_sample *sample)
+/* Feed one sample to a module's Goertzel filters; when either filter has seen
+ *  a whole block, set 'SIGNAL' to the strength of the LED wave in it.
+ * Every sample costs the same two filter steps; a result costs one more
+ *  magnitude estimate every 21 samples. A wave that appears is reported
+ *  within 63 samples (~ 200 ms), and a wave that goes away is cleared just
+ *  as fast.
+ */
+{
+    struct tone  *TONE   = &module->state->TONE;
+    unsigned int *SIGNAL = module->SIGNAL;
+    signed long   re, im;
+    unsigned long mag;
+    unsigned char f;
+    signed int    x = (signed int)(sample->value - TONE->last);
+    
+    TONE->last = sample->value;
+    
+    // s0 = x + 2cos(w)*s1 - s2
+    for (f = 0; f < 2; f++)
+    {   re = x + ((TONE_COEFF * TONE->s1[f]) >> 13) - TONE->s2[f];
+        TONE->s2[f] = TONE->s1[f];
+        TONE->s1[f] = re;
+    }
+    
+    // filter 0 finishes its block at the end of the period, filter 1 halfway
+    if      (TONE->n == TONE_N - 1)
+    {   f = 0;  }
+    else if (TONE->n == (TONE_N/2) - 1)
+    {   f = 1;  }
+    else
+    {   f = 2;  }
+    
+    ++TONE->n;
+    if (TONE->n >= TONE_N)
+    {   TONE->n = 0;   }
+    
+    if (f == 2)  // no result this time
+    {   return;    }
+    if ((TONE->ready & (1 << f)) == 0)  // block began before the first sample
+    {   TONE->ready |= (1 << f);
+        TONE->s1[f] = 0;
+        TONE->s2[f] = 0;
+        return;
+    }
+    
+    // bin 1:  X = s1 - s2(cos(w) - j sin(w))
+    re = TONE->s1[f] - ((TONE->s2[f] * TONE_COS) >> 13);
+    im = (TONE->s2[f] * TONE_SIN) >> 13;
+    re = (re < 0)? -re : re;
+    im = (im < 0)? -im : im;
+    // |X| ~ max + 3/8 min
+    if (re > im)
+    {   mag = re + ((3 * im) >> 3);   }
+    else
+    {   mag = im + ((3 * re) >> 3);   }
+    
+    // for a wave of peak to peak 'P', |X| = (N/4)(2sin(w/2))P, the second
+    //  factor coming from differencing;  4/(42 * 0.1495) ~ 1305/2048
+    mag = (mag * 1305) >> 11;
+    
+    if (mag >= TONE_MIN)
+    {   *SIGNAL = (mag > 0xFFFF)? 0xFFFF : (unsigned int)mag;  }
+    else
+    {   *SIGNAL = 0;    }
+    
+    // start this filter's next block
+    TONE->s1[f] = 0;
+    TONE->s2[f] = 0;
+}
+#endif
+
+#if DETECTOR == DETECT_LOCKIN
+static void lockin(const struct descriptor *module,
+                   const struct adc_sample *sample)
+/* Feed one sample to a module's lock-in sums; after every LOCKIN_PERIODS
+ *  LED periods, set 'SIGNAL' to the difference between the average LED-on
+ *  and LED-off levels (the same as the peak to peak of the detected wave).
  */
-{   // * auto pointers in place of their static counterparts:
-    unsigned int *count, *SIGNAL, *LDRSIG;
-    signed char  *GRDNT, *MID;
-    struct spnts *SPNTS;   
+{
+    struct lockin *LOCKIN = &module->state->LOCKIN;
+    unsigned int  *SIGNAL = module->SIGNAL;
+    unsigned int   on, off;
+    
+    // LED has just come on: a new period begins
+    if (sample->led == 1 && LOCKIN->led == 0)
+    {   if (LOCKIN->periods >= LOCKIN_PERIODS)
+        {   if (LOCKIN->n_on != 0 && LOCKIN->n_off != 0)
+            {   on  = LOCKIN->on  / LOCKIN->n_on;
+                off = LOCKIN->off / LOCKIN->n_off;
+                on  = (on > off)? (on - off) : (off - on);
+                *SIGNAL = (on >= LOCKIN_MIN)? on : 0;
+            }
+            LOCKIN->periods = 0;
+        }
+        if (LOCKIN->periods == 0)   // (a result just taken, or starting over)
+        {   LOCKIN->on    = 0;
+            LOCKIN->off   = 0;
+            LOCKIN->n_on  = 0;
+            LOCKIN->n_off = 0;
+        }
+        ++LOCKIN->periods;
+    }
+    LOCKIN->led = sample->led;
+    
+    // only sum whole periods, and only once the photoresistor has settled
+    if (LOCKIN->periods == 0 || sample->time < LOCKIN_SETTLE)
+    {   return;     }
+    
+    if (sample->led == 1)
+    {   LOCKIN->on += sample->value;
+        ++LOCKIN->n_on;
+    }
+    else
+    {   LOCKIN->off += sample->value;
+        ++LOCKIN->n_off;
+    }
+}
+#endif
+
+static void calibrate(struct calib *CAL, unsigned int diff, unsigned int SIGNAL)
+/* Add the difference between a collision detector module's last two samples
+ *  to its noise level; at the end of each block, set the module's stationary
+ *  point thresholds from it
+ */
+{
+    unsigned int noise;
+    signed int   slope;
+    
+    if (SIGNAL != 0)
+    {   // throw the block away and start another
+        CAL->sum     = 0;
+        CAL->samples = CAL_SAMPLES;
+        return;
+    }
+    if (CAL->samples <= CAL_SAMPLES)    // (not the first sample ever)
+    {   CAL->sum += diff;   }
+    if (--CAL->samples != 0)
+    {   return; }
+    
+    noise = CAL->sum / (CAL_SAMPLES / 16);
+    if (CAL->blocks == 0)
+    {   CAL->noise  = noise;
+        CAL->blocks = 1;
+    }
+    else
+    {   CAL->noise += ((signed int)noise - (signed int)CAL->noise) >> CAL_ADAPT;
+    }
+    CAL->sum     = 0;
+    CAL->samples = CAL_SAMPLES;
+    
+    slope = SPNTS_SLOPE - (signed int)(CAL->noise >> CAL_SLOPE);
+    CAL->slope = (slope < SPNTS_SLOPE_MIN)? SPNTS_SLOPE_MIN : (signed char)slope;
+    CAL->floor = ((CAL->noise >> 2) * CAL_FLOOR) >> 2;
+}
+
+static void spnts(const struct descriptor *module,
+                  const struct adc_sample *sample)
+/* Feed one sample to a module's stationary point search (see 'signal()') */
+{   struct module *m      = module->state;
+    unsigned int  *SIGNAL = module->SIGNAL;
     
     // * local vars, OK to be reset every function call:
-	//  * 'L' and 'R' are slope detection variables
-	//  * 'j' and 'k' are used in for loops
-	signed int L, R, j, k;	
+	//  * 'g_new', 'g_mid' and 'g_old' are the gradients entering the window,
+	//      crossing 'MID' and leaving the window this call
+	//  * 'j' is used in for loops
+	signed char   g_new, g_mid, g_old;
+	//  * 'k' is scratch for the speed estimate and stall test
+	signed int    j, k;	
+	//  * 'steps' is 'bb' as the stall test found it
+	unsigned int  steps = 0;
 	//  * signal detection flag for collision detector modules
 	char SIG_D = 0;
-        
-    // (1)process the analog channel; (2)assign local pointers to the addresses
-    //  of the variables and arrays of the module being analyzed
-    switch (module_no)
-    {   case 1:
-            convert_channel(0x0E);
-            count  = &count1;
-            MID    = &MID1;
-            SIGNAL = &LDR1;
-            LDRSIG = LDRSIG1;
-            GRDNT  = GRDNT1;
-            SPNTS  = SPNTS1;
-            break;
-        case 2:
-            convert_channel(0x0F);
-            count  = &count2;
-            MID    = &MID2;
-            SIGNAL = &LDR2;
-            LDRSIG = LDRSIG2;
-            GRDNT  = GRDNT2;
-            SPNTS  = SPNTS2;
-            break;
-        case 3:
-            convert_channel(0x10);
-            count  = &count3;
-            MID    = &MID3;
-            SIGNAL = &LDR3;
-            LDRSIG = LDRSIG3;
-            GRDNT  = GRDNT3;
-            SPNTS  = SPNTS3;
-            break;
-        case 4:
-            convert_channel(0x11);
-            count  = &count4;
-            MID    = &MID4;
-            SIGNAL = &LDR4;
-            LDRSIG = LDRSIG4;
-            GRDNT  = GRDNT4;
-            SPNTS  = SPNTS4;
-            break;
-        case 5:
-            convert_channel(0x12);
-            count  = &count5;
-            MID    = &MID5;
-            SIGNAL = &LDR5;
-            LDRSIG = LDRSIG5;
-            GRDNT  = GRDNT5;
-            SPNTS  = SPNTS5;
-            break;
-        case 6:
-            convert_channel(0x13);
-            count  = &count6;
-            MID    = &MID6;
-            SIGNAL = &LDR6;
-            LDRSIG = LDRSIG6;
-            GRDNT  = GRDNT6;
-            SPNTS  = SPNTS6;
-            break;
-        case 7: // M1
-            convert_channel(0x04);
-            count  = &count7;
-            MID    = &MID7;
-            SIGNAL = &LDR7;
-            LDRSIG = LDRSIG7;
-            GRDNT  = GRDNT7;
-            SPNTS  = SPNTS7;
-            break;
-        case 8: // M2
-            convert_channel(0x0D);
-            count  = &count8;
-            MID    = &MID8;
-            SIGNAL = &LDR8;
-            LDRSIG = LDRSIG8;
-            GRDNT  = GRDNT8;
-            SPNTS  = SPNTS8;
-            break;
-        default:
-            return;         
-    }
     
 // GATHER DATA
-//  Update circular buffers 'LDRSIG[21]' and 'GRDNT[20]'
+//  Update 'LDRSIG' and the gradient history 'GRDNT'
+    //  The gradient at the midpoint is about to cross to the left of it, and
+    //   the oldest gradient drops out of the window
+    g_mid = (m->GRDNT.pos & GRDNT_MID)? 1 : ((m->GRDNT.neg & GRDNT_MID)? -1 : 0);
+    g_old = (m->GRDNT.pos & GRDNT_OLD)? 1 : ((m->GRDNT.neg & GRDNT_OLD)? -1 : 0);
+    
     //  Midpoint shifts one element to the right every function call
-    if (*MID >= 20)  // at end of array:
-        *MID = 0;    //  wrap back around to beginning of array
+    if (m->MID >= 2 * SPNTS_WINDOW)  // at end of window:
+        m->MID = 0;                  //  wrap back around to beginning
     else
-        *MID += 1;     
+        m->MID += 1;     
     
-    //  Overwrite oldest elements with new data
-    if (*MID <= 10)
-    /*oldest elements of LDRSIG and GRDNT are >MID but <20*/
-    {   //LDRSIG:
-        *(LDRSIG + ((*MID)+10)) = (((unsigned int)ADRESH << 8) | ADRESL);
-        
-        //GRDNT:
-        // when positive slope, GRDNT value = 1
-        if      (*(LDRSIG + ((*MID)+9)) < *(LDRSIG + ((*MID)+10)))
-        {   *(GRDNT + ((*MID)+9)) = 1;
-        }
-        // when negative slope, GRDNT value = -1
-        else if (*(LDRSIG + ((*MID)+9)) > *(LDRSIG + ((*MID)+10)))
-        {   *(GRDNT + ((*MID)+9)) = -1;
-        }
-        // zero slope
-        else
-        {   *(GRDNT + ((*MID)+9)) = 0;
-        }
-    }       // Wrapping around the buffer:
-    else if (*MID == 11)
-    /*oldest element of GRDNT is 20; of LDRSIG is 0 */
-    {   //LDRSIG:
-        *(LDRSIG + 0) = (((unsigned int)ADRESH << 8) | ADRESL);
-        
-        //GRDNT:
-        // when positive slope, GRDNT value = 1
-        if      (*(LDRSIG + 20) < *(LDRSIG + 0))
-        {   *(GRDNT + 20) = 1;
-        }
-        // when negative slope, GRDNT value = -1
-        else if (*(LDRSIG + 20) > *(LDRSIG + 0))
-        {   *(GRDNT + 20) = -1;
-        }
-        // zero slope
-        else
-        {   *(GRDNT + 20) = 0;    
-        }
+    //GRDNT:
+    m->GRDNT.pos <<= 1;
+    m->GRDNT.neg <<= 1;
+    // when positive slope, GRDNT value = 1
+    if      (m->LDRSIG.last < sample->value)
+    {   m->GRDNT.pos |= 1;
+        g_new = 1;
     }
-    else if (*MID >= 12)
-    /*oldest elements of LDRSIG and GRDNT are < MID*/
-    {   //LDRSIG:
-        *(LDRSIG + ((*MID)-11)) = (((unsigned int)ADRESH << 8) | ADRESL);
-        
-        //GRDNT:
-        // when positive slope, GRDNT value = 1
-        if      (*(LDRSIG + ((*MID)-12)) < *(LDRSIG + ((*MID)-11)))
-        {   *(GRDNT + ((*MID)-12)) = 1;
-        }
-        // when negative slope, GRDNT value = -1
-        else if (*(LDRSIG + ((*MID)-12)) > *(LDRSIG + ((*MID)-11)))
-        {   *(GRDNT + ((*MID)-12)) = -1;
-        }
-        // zero slope
-        else
-        {   *(GRDNT + ((*MID)-12)) = 0;
-        }
+    // when negative slope, GRDNT value = -1
+    else if (m->LDRSIG.last > sample->value)
+    {   m->GRDNT.neg |= 1;
+        g_new = -1;
+    }
+    // zero slope
+    else
+    {   g_new = 0;
+    }
+    
+    //CAL (collision detectors only):
+    if (module->wheel == 0)
+    {   calibrate(&m->CAL, (m->LDRSIG.last > sample->value)?
+                           (m->LDRSIG.last - sample->value) :
+                           (sample->value - m->LDRSIG.last), *SIGNAL);
     }
+    
+    //LDRSIG:
+    m->LDRSIG.last = sample->value;
+    if (m->MID == 1)
+    {   m->LDRSIG.held = sample->value;   }
+    
+//  Update the running slopes either side of the midpoint
+    m->SLOPE.L += g_mid - g_old;
+    m->SLOPE.R += g_new - g_mid;
         
-// LOG ANY LDRSIG[] DATA POINTS THAT LOOK LIKE STATIONARY POINTS (SPNTS);
+// LOG ANY LDRSIG DATA POINTS THAT LOOK LIKE STATIONARY POINTS (SPNTS);
 //  INCREMENT 'count' FOR EVERY POINT IN BETWEEN;
 //  LOOK AT RECORDED SPNTS[] FOR EVIDENCE OF (7.6 HZ) FREQUENCY;
 //  WHEN DISCOVERED, 'SIGNAL' = SIGNAL STRENGTH
 
-    switch (*count)
+    switch (m->count)
     // only record a stationary point if the last one was > 12 counts ago
     // 'count' is reset when a stationary point is recorded
     {
         case 0: case 1: case 2: case 3: case 4: case 5: case 6:
         case 7: case 8: case 9: case 10: case 11:
-        {   ++(*count);
+        {   ++(m->count);
             break;
         }
         default:
         {
-            // DETERMINE OVERALL SLOPE
-            // * SLOPE LEFT OF MIDPOINT
-            // add together the 10 GRDNT points older than 'MID'; result is L
-            L = 0;
-            j = (*MID <= 9)? ((*MID)+11) : ((*MID)-10);
-            while (j != *MID)
-            {	L += *(GRDNT+j);
-                j++;
-                j = (j > 20)? (j-21) : j;   //wrap around to start of buffer
-            }
-            // * SLOPE RIGHT OF MIDPOINT
-            // add together the 10 GRDNT points equal to and newer than 'MID'; 
-            //  result is R
-            R = 0;
-            j = *MID;
-            k = (*MID >= 11)? ((*MID)-11) : ((*MID)+10);
-            while (j != k)
-            {   R += *(GRDNT+j);
-                j++;
-                j = (j > 20)? (j-21) : j;   //wrap around to start of buffer
-            }
-            
             // LOG STATIONARY POINTS
             // is midpoint a stationary point?
-            //  (slope either side of midpoint is +ve if > +5, and -ve if < -5)
-            if(((L > 5) && (R < -5)) || ((L < -5) && (R > 5)))
+            //  (slope either side of midpoint is +ve if > +CAL.slope, and -ve
+            //  if < -CAL.slope)
+            if(((m->SLOPE.L > m->CAL.slope) && (m->SLOPE.R < -m->CAL.slope)) ||
+               ((m->SLOPE.L < -m->CAL.slope) && (m->SLOPE.R > m->CAL.slope)))
             {
                 // if yes:
                 // * update SPNTS[] with the new voltage level and 'count'
                 //     * replace [0] with [1]
-                *SPNTS = *(SPNTS + 1);
+                m->SPNTS[0] = m->SPNTS[1];
                 //     * replace [2] with the new values
-                (SPNTS + 1)->v_level = *(LDRSIG + 11);
-                (SPNTS + 1)->count = *count;
+                m->SPNTS[1].v_level = m->LDRSIG.held;
+                m->SPNTS[1].count = m->count;
                                 
                 // * SIGNAL DETECTION:
                 //  - <wheel rotation sensor modules>
-                if (module_no == 7 || module_no == 8)
+                if (module->wheel == 1)
                 {   // if program execution reaches this far (SPNTS logged),
                     //  then we have success!
                     *SIGNAL = 1;
+                    
+                    // if the last stationary point was logged too, the
+                    //  spacing between them updates the speed estimate
+                    //  (1/4 of the way to the new value each time)
+                    if (m->SPNTS[0].count != 0)
+                    {   k = (m->count + 1) << 4;
+                        if (m->interval == 0)
+                        {   m->interval = k;  }
+                        else
+                        {   m->interval += (k - (signed int)m->interval) >> 2;
+                        }
+                        // half-steps per face = 2 x 3 x samples per half face
+                        *module->WHEEL = m->interval * 6;
+                    }
                 }
                 
                 //  - <collision detector modules>
@@ -343,7 +844,7 @@ void signal(unsigned char module_no)
                     //      distance from the previous one(~ 21 counts)
                     for(j = 0; j <= 1; j++)
                     {	// signal frequency not detected
-                        if (((SPNTS + j)->count) < 18 || ((SPNTS + j)->count) > 25)
+                        if ((m->SPNTS[j].count) < 18 || (m->SPNTS[j].count) > 25)
                         {   SIG_D = 0;
                         }                                        
                         // signal frequency detected 
@@ -353,47 +854,125 @@ void signal(unsigned char module_no)
                     }                
                     // when signal detected, assign SIGNAL a value indicating its
                     //  strength (i.e. SIGNAL = difference between the two SPNTS[]
-                    //  voltage levels)
+                    //  voltage levels), as long as it stands out from the noise
                     if (SIG_D == 2)
                     {   
-                        if ((SPNTS + 0)->v_level > (SPNTS + 1)->v_level)
-                        {	*SIGNAL = ((SPNTS + 0)->v_level - (SPNTS + 1)->v_level);
+                        if (m->SPNTS[0].v_level > m->SPNTS[1].v_level)
+                        {	k = (m->SPNTS[0].v_level - m->SPNTS[1].v_level);
                         }
                         else
-                        {	*SIGNAL = ((SPNTS + 1)->v_level - (SPNTS + 0)->v_level);
+                        {	k = (m->SPNTS[1].v_level - m->SPNTS[0].v_level);
                         }
+                        if (k > m->CAL.floor)
+                        {   *SIGNAL = k;    }
                     }
                 }                
                 // * reset count when a stationary point is logged
-                *count = 0;
+                m->count = 0;
             }
             // if not a stationary point, increment 'count':
             else
-            {	++(*count); }
+            {	++(m->count); }
             break;
         }
     }   /*end of switch(count)*/
     
+    // <wheel rotation sensor modules>
+    //  a stationary point is overdue if it hasn't come in twice the usual
+    //  spacing: the wheel has slowed to half speed or less, so spring the
+    //  "wheel stuck" signal.  Only count samples taken since the current
+    //  move() began, as the sensors are not watched between moves.
+    if (module->wheel == 1)
+    {   k = ((m->interval == 0)? WHEEL_NOMINAL : m->interval) >> 3;
+        steps = bb_read();      // (the T2 interrupt counts 'bb')
+        if (m->count > k && steps > 3 * k)
+        {   *SIGNAL = 0;    }
+    }
+    
     // if 'count' increments above 42 ('SIGNAL' hasn't been detected for one
     //  period), reset 'count' and all SPNTS[] elements; and SIGNAL = 0
-    if (*count >= 42)
+    if (m->count >= 42)
     {	for (j = 0; j < 2; j++)
-        {	if ((SPNTS + j)->v_level != 0 || (SPNTS + j)->count != 0)
-            {   (SPNTS + j)->v_level = 0;
-                (SPNTS + j)->count   = 0;
+        {	if (m->SPNTS[j].v_level != 0 || m->SPNTS[j].count != 0)
+            {   m->SPNTS[j].v_level = 0;
+                m->SPNTS[j].count   = 0;
             }
         }
-        if (module_no == 7 || module_no == 8)
-        {   // don't spring "wheel stuck" signal until after 1/3 revolution
-            //  i.e. give the module time to rack up at least 2 'SPNTS'
-            if (bb > 300)
+        if (module->wheel == 1)
+        {   // same restriction as above: 42 samples since move() began
+            if (steps > 3 * 42)
             {   *SIGNAL = 0;  }
         }
         else
             // no such restriction for collision detector LDR's
         {   *SIGNAL = 0;    }
     
-        *count = 0;
+        m->count = 0;
+    }
+}
+
+
+#if DETECTOR == DETECT_TONE
+#define collision_engine tone
+#elif DETECTOR == DETECT_LOCKIN
+#define collision_engine lockin
+#else
+#define collision_engine spnts
+#endif
+
+void wheel_reset(void)
+/* Forget the wheel speed estimates and stationary points, so that the next
+ *  movement is measured afresh
+ */
+{
+    unsigned char i;
+    
+    for (i = 0; i < MODULES; i++)
+    {   if (DESCRIPTOR[i].wheel == 1)
+        {   MODULE[i].count    = 0;
+            MODULE[i].interval = 0;
+            MODULE[i].SPNTS[0].v_level = 0;
+            MODULE[i].SPNTS[0].count   = 0;
+            MODULE[i].SPNTS[1].v_level = 0;
+            MODULE[i].SPNTS[1].count   = 0;
+            MODULE[i].tail = MODULE[i].head;    // drop old samples
+            *DESCRIPTOR[i].WHEEL = 0;
+        }
     }
 }
 
+void signal(unsigned char module_no)
+/*  'module_no' (1, 2, 3, 4, 5, 6, 7, or 8) specifies which photosensor
+ *      module to analyze.  A meaningless value for 'module_no' does nothing.
+ *  Every ADC result waiting in the module's 'RING' is passed to its detection
+ *      engine; if there are none, nothing happens.
+ * <collision detectors> (mod. 1-6)
+ *  [~ 3 milliseconds (or 6 Timer4 interrupts) per module]
+ * The ADC scanner samples each module in turn every 520 microseconds; the
+ *  data is searched for a frequency of 7.6295 Hz.  As long as it cannot be
+ *  found, SIGNAL = 0; when the target frequency is consistently apparent,
+ *  SIGNAL equals a value indicating its strength.
+ * <wheel rotation sensors> (mod. 7, 8)
+ *  [~ 5.8 milliseconds (or 3 Timer2 interrupts) per module]
+ * Similar process to 'collision detectors.'  A consistent 'SIGNAL == 1' means
+ *  the wheels are turning.
+ */
+{   const struct descriptor *module;
+    struct module *m;
+    struct adc_sample sample;
+    
+    if (module_no == 0 || module_no > MODULES)
+    {   return;     }
+    module = &DESCRIPTOR[module_no - 1];
+    m      = module->state;
+    
+    while (m->tail != m->head)
+    {   sample  = m->RING[m->tail];
+        m->tail = (m->tail + 1) & (ADC_RING - 1);
+        
+        if (module->wheel == 1)
+        {   spnts(module, &sample);  }
+        else
+        {   collision_engine(module, &sample);   }
+    }
+}
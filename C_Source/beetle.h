@@ -25,21 +25,65 @@ extern "C" {
 #define m2ph2 LA6      //         motor 2 phase 2
 // signal to turn move() inverter on or off
 #define IEN   LA7
-// PushButton sensors input
-#define PB1   PORTBbits.RB1
-#define PB2   PORTBbits.RB2
-#define PB3   PORTBbits.RB0
-#define PB4   PORTBbits.RB4
-
-// [bx_y] refers to [variable x, motor y]
-extern unsigned int b1_1, b1_2, b2_1, b2_2;
-// symbols for motor1 & motor2
-extern volatile bit M1, M2;
+// PushButton sensors input (debounced, see 'buttons')
+#define PB1   ((buttons >> 1) & 1)      // RB1
+#define PB2   ((buttons >> 2) & 1)      // RB2
+#define PB3   (buttons & 1)             // RB0
+#define PB4   ((buttons >> 4) & 1)      // RB4
+// the debounced level of every pushbutton on PORTB (RB0-2 & 4 bumpers; RB6 &
+//  7 master), as a PORTB image: 1 = pressed
+#define BUTTONS 0xD7
+extern volatile unsigned char buttons;
+
+// LATA bits driven by the half-step sequence: L0, L1 and the four phases
+#define STEP_MASK 0x5F
+// LATA image of each of the 8 half-steps of the movement set up by move()
+extern unsigned char STEP[8];
+// L0 & L1 bits added to every half-step (see 'power_update()'): 0x01 takes
+//  the 100% current half-steps down to 60%
+extern unsigned char current_trim;
 // these increment every motor half-step
 extern volatile unsigned char aa, cc; 
 extern volatile unsigned int  bb;
 // this tells bb when to stop incrementing
-extern unsigned int bb_stop;
+extern volatile unsigned int bb_stop;
+// the pivot in progress, in degrees (0 = none), and the no. of half-steps per
+//  degree of pivot x256, as measured by the wheel rotation sensors
+extern volatile unsigned int pivot_deg;
+extern unsigned int steps_per_deg;
+// half-step period: PR2 x 10 us (Timer2 presc. 1:16, postsc. 1:5); every
+//  movement starts at RAMP_START and accelerates along a ramp, position 'ramp',
+//  up to the cruising speed at position 'ramp_top' (0 - RAMP_TOP)
+#define RAMP_START 0xC0     // 1920 us
+#define RAMP_TOP   32       // 1200 us
+extern volatile unsigned char ramp;
+extern unsigned char ramp_top;
+// cruising speed (ramp position) of the movement in progress, and the T2
+//  interrupts still to wait before a queued movement starts (see 'motion()')
+extern volatile unsigned char cruise, motion_delay;
+// arcs (see 'arc()'): 'arcing' is set while the motors full-step at rates of
+//  their own, M1 on Timer2 and M2 on Timer3; 'arc_m1' & 'arc_m2' are their
+//  positions in the full-step cycle (0-3), and 'arc_dir' is added to both
+//  every step (1 forward, 3 reverse). 'dd' does for M2 what 'cc' does for M1.
+extern volatile unsigned char arcing, arc_m1, arc_m2, dd;
+extern unsigned char arc_dir;
+// dead reckoning (see 'odometry()'): position in mm x256 from where the robot
+//  was switched on (+x being the way it faced then), and heading in 65536ths
+//  of a turn anticlockwise from +x
+struct pose
+{   signed long  x, y;
+    unsigned int heading;
+};
+extern struct pose POSE;
+// half-steps turned by M1 & M2 but not yet added to 'POSE' (+ve forward), and
+//  how many each interrupt adds
+extern volatile signed char odo_1, odo_2;
+extern signed char step_1, step_2;
+// when move() (and pivot()) are to start the movement
+typedef enum
+{   MOVE_NOW,       // right away
+    MOVE_WAIT       // after ~500 ms with the motors off
+} when_t;
 // this tells mainloop whether or not it's waiting to engage motor interrupt
 extern unsigned char waiting;
 // a variable that remembers the last move() operation
@@ -49,9 +93,22 @@ extern unsigned char prev_mode;
 // LDRx says whether photosensor signal 'x' has been detected, and (modules 1-6)
 //  gives signal strength if it has.
 extern unsigned int LDR1, LDR2, LDR3, LDR4, LDR5, LDR6, LDR7, LDR8;
+// WHEELx is the filtered no. of motor half-steps per hex face turned by the
+//  M1 (7) or M2 (8) wheel, x16; ~1650 when turning freely, 0 until measured
+extern unsigned int WHEEL7, WHEEL8;
+
+// Collision detection engine for modules 1-6, picked at build time.
+//  Either way 'signal()' is called the same, and LDR1-6 hold the signal
+//  strength (peak to peak, in ADC counts) or 0.
+#define DETECT_SPNTS  0     // stationary points spaced at the LED frequency
+#define DETECT_TONE   1     // fixed-point Goertzel filter at the LED frequency
+#define DETECT_LOCKIN 2     // LED-on minus LED-off level, in step with CCP2
+#ifndef DETECTOR
+#define DETECTOR      DETECT_SPNTS
+#endif
 
 //  STATE is the result of any incoming signals
-extern volatile unsigned int STATE @ (0xF36);
+extern volatile unsigned int STATE __at(0xF36);
 typedef union 
 {   struct  //each labeled bit in 'STATE' is an event flag pointing to a signal
     {   unsigned l1     : 1;    // cntr-clkws from front right collision sensor:
@@ -70,66 +127,82 @@ typedef union
         unsigned unused : 3;    //unused
     };
 } STATEbits_t;
-extern volatile STATEbits_t STATEbits @ (0xF36);
+extern volatile STATEbits_t STATEbits __at(0xF36);
+// groups of event flags in 'STATE'
+#define STATE_FRONT 0x001F  // l1, p1, l2, p2, l3
+#define STATE_REAR  0x03E0  // l4, p3, l5, p4, l6
+#define STATE_WHEEL 0x0C00  // l7, l8
+#define STATE_DONE  0x1000
+// what 'state_event()' finds STATE calls for, besides a collision event
+#define REACT_DONE  STATE_DONE  // signal 'done' alone
+#define REACT_HANG  0xFFFF      // signal 'done' + a hardware signal
 
 //***************** other ******************************************************
+// events the interrupts post for mainloop, in the order they happen (see
+//  'event_post()'); 'time' is when, in Timer0 counts (4 us)
+struct event
+{   unsigned char type, data;
+    unsigned int  time;
+};
+#define EV_STOP    1        // the motors have stopped at 'bb_stop'
+#define EV_ADC     2        // a new sample for module 'data' (1-8)
+#define EV_PRESS   3        // pushbuttons pressed: 'data' = their PORTB bits
+#define EV_BATTERY 4        // battery level: 'data' = ADC counts / 4
+#define EV_RELEASE 5        // pushbuttons released: 'data' = their PORTB bits
+#define EV_MASTER  6        // a master pushbutton pressed: 'data' = 'buttons' then
+// mainloop tasks, in order of priority (see 'sched_run()')
+#define TASK_SENSE   0      // signal() 1-8
+#define TASK_REACT   1      // dead reckoning; STATE & reactions; wandering
+#define TASK_UI      2      // master pushbuttons
+#define TASK_BATTERY 3      // battery level
+#define TASKS        4
+
+// battery level (the RB3 indicator voltage, in ADC counts / 4  i.e. ~ 19.5 mV)
+//  at which each power mode begins; a mode is only left for the one above
+//  once the level is BATT_HYST over that one's threshold again
+#define BATT_FULL  128      // 2.50 v: 100% charge
+#define BATT_SAVE  112      // 2.19 v
+#define BATT_LOW   104      // 2.03 v
+#define BATT_EMPTY  96      // 1.88 v: 0% charge (comparator 1 used to trip here)
+#define BATT_HYST    3
+// power modes, in order (see 'power_update()')
+#define POWER_FULL 0        // as normal
+#define POWER_SAVE 1        // slower, with less motor current & fewer LED pulses
+#define POWER_LOW  2        // slower & fewer pulses still; status LED off
+#define POWER_OFF  3        // shut down
+extern unsigned char power, battery_soc;    // battery_soc: charge left, 0-100%
+// what the status LED (LATC0) shows for "on"
+#define STATUS_LED (power < POWER_LOW)
+
 // needed for __delay_ms() & __delay_us() functions
 #define _XTAL_FREQ 32000000
 
-// pseudo-random bit sequence buffer
-extern volatile unsigned int SHFTREG @ 0xF34;
-typedef union
-{   struct
-    {   unsigned a  : 1;
-        unsigned b  : 1;
-        unsigned c  : 1;
-        unsigned d  : 1;
-        unsigned e  : 1;
-        unsigned f  : 1;
-        unsigned g  : 1;
-        unsigned h  : 1;
-        unsigned i  : 1;
-        unsigned j  : 1;
-        unsigned k  : 1;
-        unsigned l  : 1;
-        unsigned m  : 1;
-        unsigned n  : 1;
-        unsigned o  : 1;
-        unsigned p  : 1;
-    };
-} SHFTREGbits_t;
-extern volatile SHFTREGbits_t SHFTREGbits @ 0xF34;
-
-// more than one piece of code uses Timer6: don't run two or more simultaneously
-extern bit Dbounce_in_progress; 
-
-// De-bouncing Initialization:
-#define Dbounce_ms(_sfr_, _bit_)    Dbounce_in_progress = 1;    \
-                                    sample_time = 5;            \
-                                    SFR = _sfr_;  BIT = _bit_;  \
-                                    TMR6IF = 0;                 \
-                                    PR6 = 0xFF;                 \
-                                    T6CON = 0xFF;               
-
-// Reaction Initialization:
-#define trigger_front(event)    reaction = event;               \
+// what 'rand()' is to come up with
+typedef enum
+{   RAND_DIRECTION,     // 'L' or 'R'
+    RAND_MOVE,          // 3 - 6
+    RAND_DEGREE,        // 80 - 207
+    RAND_TIME           // 1536 - 8191
+} rand_t;
+// pseudo-random number generator state (see 'rand()')
+extern volatile unsigned int SHFTREG __at(0xF34);
+
+// set while 'sing()' is playing a song in the background
+extern volatile bit singing;
+
+// the songs 'sing()' knows
+typedef enum
+{   SING_ON, SING_OFF, SING_START, SING_STOP
+} song_t;
+
+// Reaction Initialization: (the whole reaction is queued, see 'react()')
+#define trigger_front(event)    reaction = 'q';                 \
                                 LATC0 = 0;                      \
-                                move(0, "now");                 \
-                                move(2, "wait");                \
-                                bb_stop = 255;
+                                react(event, 2);
 
-#define trigger_rear(event)     reaction = event;               \
+#define trigger_rear(event)     reaction = 'q';                 \
                                 LATC0 = 0;                      \
-                                move(0, "now");                 \
-                                move(1, "wait");                \
-                                bb_stop = 255;
-
-// ADC Conversion Sequence:
-#define convert_channel(ch)     ADCON0bits.CHS = ch;            \
-                                ADON = 1;                       \
-                                GO_nDONE = 1;                   \
-                                while(GO_nDONE == 1){   ;}      \
-                                ADIF = 0;                   
+                                react(event, 1);
 
 #endif	/* BEETLE_H */
 
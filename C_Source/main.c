@@ -79,33 +79,431 @@
 //********************* extern functions ***************************************
 // sensory
 extern void         start_signal(void);
+extern void         start_signal_poll(void);
 extern void         stop_signal(void);
+extern void         signal_gate(void);
 extern void         signal(unsigned char);
+extern unsigned int adc_noise(void);
+extern bit          battery_sample(unsigned char *);
 // motor control
-extern void         sing(const char[]);
-extern void         move(char, const char[]);
-extern void         pivot(unsigned int, unsigned int);
-extern unsigned int rand(const char[]);
+extern void         sing(song_t);
+extern void         move(char, unsigned int, when_t);
+extern void         arc(char, unsigned int, unsigned int, unsigned int);
+extern void         odometry(void);
+extern void         pivot(unsigned int, unsigned int, when_t);
+extern void         pivot_track(void);
+extern bit          motion(char, unsigned int, unsigned char, unsigned char);
+extern void         motion_go(void);
+extern bit          motion_busy(void);
+extern unsigned int rand(rand_t);
+extern void         rand_seed(unsigned int);
 // main
-extern bit          Dbounce_us(volatile unsigned char *, char);
-extern void high_priority interrupt T6 (void);
+extern unsigned char power_update(unsigned char);
+extern unsigned int sched_time(void);
+extern bit          event_get(struct event *);
+extern unsigned int bb_read(void);
+extern volatile unsigned char events_lost;
+extern void         sched_run(void);
+extern void         react(unsigned int, char);
+extern unsigned int state_event(unsigned int);
 extern void low_priority  interrupt T2 (void);
 
 //********************* global vars definition *********************************
-unsigned int b1_1, b1_2, b2_1, b2_2;
-volatile bit M1, M2;
+unsigned char STEP[8];
+unsigned char current_trim = 0x00;
 volatile unsigned int STATE = 0x00;    
 unsigned int LDR1 = 0, LDR2 = 0, LDR3 = 0, LDR4 = 0, LDR5 = 0, LDR6 = 0,
     LDR7 = 1, LDR8 = 1;
+unsigned int WHEEL7 = 0, WHEEL8 = 0;
 volatile unsigned char aa = 0, cc = 0;
 volatile unsigned int bb = 1;
-unsigned int bb_stop = 0;
+volatile unsigned int bb_stop = 0;
+volatile unsigned int pivot_deg = 0;
+unsigned int steps_per_deg = 560;
+volatile unsigned char ramp = 0;
+unsigned char ramp_top = 18;    // 1400 us
+volatile unsigned char cruise = RAMP_TOP, motion_delay = 0;
+volatile unsigned char arcing = 0, arc_m1 = 0, arc_m2 = 0, dd = 0;
+unsigned char arc_dir = 1;
+struct pose POSE = {0, 0, 0};
+volatile signed char odo_1 = 0, odo_2 = 0;
+signed char step_1 = 0, step_2 = 0;
 unsigned char waiting = 'n';
 unsigned char prev_mode = 0;
 volatile unsigned int SHFTREG = 0x00;
-bit Dbounce_in_progress = 0;
+volatile bit singing = 0;
+volatile unsigned char buttons = 0;
+unsigned char power = POWER_FULL, battery_soc = 100;
 
 
+//********************* mainloop ***********************************************
+/* The mainloop is a cooperative scheduler (see 'sched_run()' & 'TASK[]' in
+ *  MainFunctions.c): each task below runs once its period is up, and after
+ *  any task has run, the loop starts again from the top, so a task higher up
+ *  never waits on more than one task below it: sensing comes first. Each
+ *  time round, the events posted by the interrupts are taken first.
+ */
+static bit           active      = 0; // toggled by master pushbutton 1
+static unsigned int  reaction    = 0; 
+static unsigned int  turntime    = 0;
+static unsigned char mode        = 0; // for use in reaction 'fun' 
+    /*  Events from the interrupts:   */
+static unsigned char fresh       = 0; // modules (bit 0 = 1) with new samples
+static unsigned char lost        = 0; // 'events_lost' as last seen
+static unsigned char done        = 0; // motors stopped at 'bb_stop'
+static unsigned char pressed     = 0; // master pushbutton(s) pressed...
+static unsigned int  press       = 0; //  ...at this time
+static unsigned char battery     = 0; // a battery level has been measured...
+static unsigned char level       = 0; //  ...this one
+
+static void events_take(void)
+/* TAKE EVENTS FROM THE INTERRUPTS, in the order they were posted */
+{
+    struct event  ev;              // the one being taken from the ring
+    
+    while (event_get(&ev) == 1)
+    {   switch (ev.type)
+        {   case EV_ADC:
+                fresh |= (unsigned char)(1 << (ev.data - 1));
+                break;
+            case EV_STOP:
+                done = 1;
+                break;
+            case EV_MASTER:
+                // a master pushbutton, and the only one held down as it was
+                //  pressed (not e.g. PORTB6 pressed while 7 still was)
+                if ((ev.data & 0xC0) == 0x40 || (ev.data & 0xC0) == 0x80)
+                {   pressed = ev.data & 0xC0;
+                    press = ev.time;
+                }
+                break;
+            case EV_BATTERY:
+                level = ev.data;
+                battery = 1;
+                break;
+            default:
+                break;
+        }
+    }
+    if (events_lost != lost)
+    // the ring overflowed: any module may have new samples
+    {   lost = events_lost;
+        fresh = 0xFF;
+    }
+}
+
+void task_sense(void)
+/* TASK_SENSE: signal() 1-8 */
+{
+    unsigned char module;          // track 'signal()' module(1-6)
+    
+    // (the signal LED's start after a period, see 'start_signal()')
+    start_signal_poll();
+    
+    // PROCESS LDR SENSOR INPUTS
+    /* The ADC scanner samples the collision detectors in the background
+     *  anytime Timer4 is running  i.e. if start_signal() has been called;
+     *  signal() processes whatever samples have come in since last time.
+     */
+    for (module = 1; module <= 6; module++)
+    {   if ((fresh & (1 << (module - 1))) != 0)
+        {   signal(module);     // signal() 1-6
+        }
+    }
+    /* Wheel rotation sensors are sampled every 3 Timer2 interrupts;
+     *  only process them:
+     *  When Beetle is in active mode           (active == 1)
+     *  When there is no reaction taking place  (reaction == 0),
+     *      or the reaction is a pivot              (pivot_deg != 0)
+     */
+    if (active == 1 && (reaction == 0 || pivot_deg != 0))
+    {   signal(7);      // (and during pivots, which stop on how far the
+        signal(8);      //  wheels have actually turned)
+    }
+    fresh = 0;
+}
+
+void task_react(void)
+/* TASK_REACT: dead reckoning; STATE & reactions; wandering */
+{
+    unsigned int  state;           // holds the previous 'STATE'
+    unsigned int  event;           //  ...and what the new one calls for
+    unsigned char turn;            // the random turn taken every so often
+    
+    // KEEP TRACK OF WHERE BEETLE HAS GOT TO
+    odometry();
+    pivot_track();
+
+    // EVENT FLAGS  i.e. UPDATE 'STATE'  i.e. CHECK ALL SIGNALS
+        // remember the state of STATE before updating
+    state = STATE;
+        // * FRONT RIGHT
+    STATEbits.l1 = (LDR1 == 0)? (unsigned)0 : 1; 
+    STATEbits.p1 = (PB1 == 0)?  (unsigned)0 : 1; 
+
+        // * FRONT MIDDLE
+    STATEbits.l2 = (LDR2 == 0)? (unsigned)0 : 1;
+
+        // * FRONT LEFT
+    STATEbits.p2 = (PB2 == 0)?  (unsigned)0 : 1;
+    STATEbits.l3 = (LDR3 == 0)? (unsigned)0 : 1;
+
+        // * BACK LEFT
+    STATEbits.l4 = (LDR4 == 0)? (unsigned)0 : 1;
+    STATEbits.p3 = (PB3 == 0)?  (unsigned)0 : 1;
+
+        // * BACK MIDDLE
+    STATEbits.l5 = (LDR5 == 0)? (unsigned)0 : 1;
+
+        // * BACK RIGHT
+    STATEbits.p4 = (PB4 == 0)?  (unsigned)0 : 1;
+    STATEbits.l6 = (LDR6 == 0)? (unsigned)0 : 1;
+
+        // * RIGHT WHEEL STUCK
+    STATEbits.l7 = (LDR7 == 1)? (unsigned)0 : 1;
+
+        // * LEFT WHEEL STUCK
+    STATEbits.l8 = (LDR8 == 1)? (unsigned)0 : 1;
+
+        // * SOFTWARE SIGNAL 'END OF REACTION'
+    //      (held back while singing, which uses the motors)
+    STATEbits.done = (done == 1 && singing == 0)? (unsigned)1 : 0;
+
+
+    // PERFORM REACTIONS BASED ON 'STATE'
+    //      react only upon a change in STATE, if active
+    if (STATE != state && active == 1)
+    /* Every STATE gets a Reaction: 'state_event()' says which, most
+     *  urgent first (a "hanging state"; signal 'done'; a front, rear,
+     *  or wheel signal; or nothing).
+     * Collision reactions are queued whole by a "trigger" macro, and
+     *  the Timer2 Interrupt runs them through to driving on forward
+     *  (see 'react()'). Other reactions give move() or arc() a
+     *  non-0 stop ('bb_stop'); when 'bb' reaches this value ('bb'
+     *  increments in Timer2 Interrupt), the reaction is continued or
+     *  finished under signal 'done'. 
+     *  This sequence can last as many times as necessary.
+     */
+    {   event = state_event(STATE);
+        if (event == REACT_HANG)
+        // "hanging state": play it safe and reverse (as far as the
+        //  last movement went: it has stopped, so 'bb_stop' holds)
+        {   move(2, bb_stop, MOVE_WAIT);
+            LDR7 = 1;
+            LDR8 = 1;
+        }
+        else if (event == REACT_DONE)
+        // software signal "done"
+        {
+            switch(reaction)
+            {   // go forward
+                case 'g':
+                    LATC0 = STATUS_LED;     // LED on
+                    move(1, 0, MOVE_NOW);   // proceed forward
+                    reaction = 0;
+                    turntime = rand(RAND_TIME);
+                    break;
+
+                // stop
+                case 's':
+                    LATC0 = 0;
+                    move(0, 0, MOVE_NOW);
+                    break;
+
+                // just for fun
+                case 'f':
+                    // perform all move() modes, then stop and sing()
+                    move(mode, (mode == 0)? 0 : 410, MOVE_WAIT);
+                    if (mode == 0)  // time to stop
+                    {   reaction = 0;
+                        sing(SING_STOP);
+                        active = 0;
+                    }
+                    mode++;
+                    if (mode >= 9)
+                    {   mode = 0;
+                    }
+                    break;
+
+                default:    // shouldn't happen
+                    break;
+            }
+            // Do this if not finished yet
+            if (reaction != 0 && reaction != 'f' && reaction != 'q')
+            {   reaction = 'g';     // finish next time
+            }
+        }
+        else if ((event & STATE_REAR) != 0)
+        {   trigger_rear(event);
+        }
+        else if (event != 0)
+        // a front collision, or LDR7 (left wheel stuck), LDR8 (right
+        //  wheel stuck), or both
+        {   trigger_front(event);
+        }
+        // a stuck wheel is dealt with by whatever reaction came of it
+        if ((STATE & STATE_WHEEL) != 0)
+        {   LDR7 = 1;
+            LDR8 = 1;
+        }
+    }
+    // signal 'done' is only given once per stop
+    if (STATEbits.done == 1)
+    {   done = 0;
+    }
+    // A QUEUED REACTION HAS RUN ITS COURSE  (and Beetle is driving on)
+    if (reaction == 'q' && motion_busy() == 0)
+    {   LATC0 = STATUS_LED;     // LED on
+        reaction = 0;
+        turntime = rand(RAND_TIME);
+    }
+    // A MECHANISM TO WAIT A MOMENT BEFORE MOVING
+    if (TMR2IF == 1 && waiting != 'n')
+    // while waiting: count Timer2 interrupt flags to keep track of time
+    {   TMR2IF = 0;
+        ++waiting; 
+        if (waiting == 40) // condition 'proceed' (~500 ms wait time)
+        // configure Timer2 interrupt now for move()
+        {   waiting = 'n';
+            // interrupt period = 1920 us (i.e. 15360 cyc) to start with
+            T2CON = 0b00100111;        //[presc. = 1:16]; [postsc. = 1:5]
+            PR2 = RAMP_START;
+            ramp = 0;
+            // interrupt enabled, flag LOW
+            TMR2IE = 1; 
+            TMR2IF = 0;
+            // enable motor logic inverter
+            IEN    = 1;
+        }
+    }        
+    // AFTER ~ 3 to 15 SECONDS OF SMOOTH DRIVING:
+    if (bb_read() >= turntime && active == 1 && reaction == 0)
+    // randomly pivot, or veer off in an arc without stopping
+    {   turn = rand(RAND_MOVE);
+        if (turn == 5)      // arc to the right: M1 outside
+        {   arc(1, 3840, 3840 + 20 * rand(RAND_DEGREE),
+                rand(RAND_DEGREE) * 5 / 4);     // (M1 full steps)
+        }
+        else if (turn == 6) // arc to the left: M2 outside
+        {   arc(1, 3840 + 20 * rand(RAND_DEGREE), 3840,
+                rand(RAND_DEGREE) * 5 / 8);     // (M1 full steps)
+        }
+        else
+        {   pivot((turn == 3)? 'R' : 'L', rand(RAND_DEGREE), MOVE_NOW);
+        }
+        reaction = 'g';
+    }
+}
+
+void task_ui(void)
+/* TASK_UI: master pushbuttons */
+{
+    // USER INTERFACE
+    /*  <Master pushbutton commands>
+     *  The pushbuttons are debounced in the Timer0 interrupt (see
+     *   'buttons_sample()'), which posts an event when one has been
+     *   pressed; only one of PORTB6 & 7 at a time counts (pressed
+     *   together, or one while the other is held, neither does).
+     */
+    if (pressed != 0)
+    {   // exactly when a button is pressed is down to the user
+        rand_seed(press);
+
+        // MasterPushButton Commands------------------------------------
+        /*  PushButton1 (PORTB6)    */
+        if (pressed == 0x40)
+        {   // stop/start
+            if (active == 0)        // currently stopped:
+            {   start_signal();     //  start
+                LATC0 = STATUS_LED;
+                sing(SING_START);
+                motion(1, 0, 0, RAMP_TOP);  // (after the song)
+                motion_go();
+                active = 1;
+                turntime = rand(RAND_TIME);
+            }
+            else if (active == 1)   // currently active:
+            {   move(0, 0, MOVE_NOW);   //  stop
+                stop_signal();
+                LATC0 = 0;
+                sing(SING_STOP);
+                reaction = 0;
+                active = 0;
+                turntime = 0;
+            }          
+        }
+        /*  PushButton2 (PORTB7)    */
+        else if (pressed == 0x80)
+        {   // stop if currently active
+            if (active == 1)
+            {   move(0, 0, MOVE_NOW);
+                stop_signal();
+                LATC0 = 0;
+                sing(SING_STOP);
+                reaction = 0;
+                active = 0;
+                turntime = 0;
+            }
+            // otherwise showcase what beetle can do
+            else if (active == 0)
+            {   sing(SING_START);
+                mode = 1;
+                reaction = 'f'; // set reaction 'fun' in motion
+                done = 1;       // trigger signal 'done'
+                active = 1;
+            }
+        }
+        //--------------------------------------------------------------
+        pressed = 0;
+    }
+}
+
+void task_battery(void)
+/* TASK_BATTERY: battery level */
+{
+    // MONITOR BATTERY LEVEL
+    if (battery == 1 && power_update(level) == POWER_OFF)
+    {   /* <Shutdown:>
+         * stop any running processes;
+         * make all pins digital outputs @ 0
+         *  except make sure motors aren't sinking current;
+         * SLEEP
+         */
+
+        move(0, 0, MOVE_NOW);
+        sing(SING_OFF);
+        while (singing == 1)
+        {;} // (CCP5 interrupt)
+
+        //Peripheral Module Disable: (stop the clock to all peripherals)
+        PMD0 = 0xFF;
+        PMD1 = 0xFF;
+        PMD2 = 0xFF;
+
+        // All pins LOW digital outputs
+        TRISA = 0x00;
+        TRISB = 0x00;
+        TRISC = 0x00;
+        ANSELA = 0x00;
+        ANSELB = 0x00;
+        ANSELC = 0x00;
+        LATA = 0x03;    // except for LA0 & LA1: HIGH digital outputs
+        LATB = 0x00;
+        LATC = 0x00;
+
+        SLEEP();
+    }
+    // the next level: measured now, or arriving later as EV_BATTERY
+    battery = battery_sample(&level);
+    
+    // fewer signal LED pulses in the lower power modes
+    signal_gate();
+    // the status LED goes out for good in POWER_LOW (it's only on
+    //  while driving, with no reaction under way)
+    if (active == 1 && reaction == 0)
+    {   LATC0 = STATUS_LED; }
+}
+
 int main(void) 
 {  
 //************************* RESET **********************************************
@@ -123,16 +521,17 @@ int main(void)
     //  RA5 configured as analog input (M1 "wheel stuck" photosensor)
     TRISA = 0x20;
     ANSELA = 0x20;
-    // port B(0-4, 6, & 7) configured as dig. inputs (pushbuttons);
-    //  RB5 configured as analog input (M2 "wheel stuck" photosensor)
+    // port B(0-2, 4, 6, & 7) configured as dig. inputs (pushbuttons);
+    //  RB5 configured as analog input (M2 "wheel stuck" photosensor),
+    //  and RB3 (battery level indicator)
     TRISB = 0xFF;
-    ANSELB = 0x20;
+    ANSELB = 0x28;
     // led's & photosensor inputs: pins RC2-7 analog in; RC0-1 dig. out
     TRISC = 0xFC;
     ANSELC = 0xFC;
 
     // say Hello (and IMPORTANT: initialize stepper motors to OFF)
-    sing("on");
+    sing(SING_ON);
     
     // flash LED's
     LATC1 = 1; LATC0 = 1;
@@ -143,436 +542,30 @@ int main(void)
     __delay_ms(200);
     LATC1 = 0; LATC0 = 0;
     
-    // master pushbuttons setup
-    IOCBbits.IOCB6 = 1; // interrupt on change pins RB6 & 7 enabled
-    IOCBbits.IOCB7 = 1;
-    RBIF = 0;           // flag clear
+    // pushbuttons: sampled & debounced every other Timer0 tick (see
+    //  'buttons_sample()')
+    
+    // random numbers: seed from the noise on the LDR inputs (and later, the
+    //  time of each master pushbutton press)
+    rand_seed(adc_noise());
+    
+    // mainloop scheduler: Timer0 ticks every 1.024 ms (256 x 4 us)
+    T0CON = 0b11000100; // timer0 on; 8-bit; fosc/4; presc. 1:32
+    TMR0IF = 0;
+    TMR0IE = 1;
     
     /* Battery level--------------------------------
-     *  An indicator voltage drives port RB3 (comparator input channel C12IN2-).
-     *  Comparator module 1 monitors this voltage with respect to (DAC) 1.41v.
-     *  SHUTDOWN is triggered when C1IF is set and it passes a filter test.
+     *  An indicator voltage drives port RB3 (AN9). TASK_BATTERY measures it
+     *  through the ADC (see 'battery_sample()') and steps Beetle down through
+     *  the power modes as it falls (see 'power_update()'), to SHUTDOWN.
      */
-    // Setup & enable DAC module:
-    VREFCON1 = 0b10000000;  //enabled
-    VREFCON2 = 0x0C;        //DACR '12'  i.e. Vref ~ 1.875v
-    // Enable Comparator1:
-    //  C1ON => enabled; C1OUT => 0; C1OE => disabled; C1POL => not inverted;
-    //  C1SP => high-speed mode; C1R => C1Vref output; C1CH => C12IN2-(pin RB3)
-    CM1CON0 = 0b10001110;
-    // Rout DAC output to C1 voltage reference pin (+ve input)
-    C1RSEL = 0;
-    // Wait for comparator response time & bias circuitry settling (1 us)
-    __delay_us(1);
-    // Read CM1CON0  i.e. clear mismatch latches
-    CM1CON0;
-    // Interrupt flag (IOC disabled): 
-    C1IF = 0;    //  clear flag
-    C1IE = 0;
     //----------------------------------------------
         
-    // mainloop local variables
-    static bit    active      = 0; // toggled by master pushbutton 1
-    unsigned char module      = 0; // track 'signal()' module(1-6)
-    static bit    do_mod_8    = 0;
-    unsigned int  reaction    = 0; 
-    unsigned int  turntime    = 0;
-    unsigned int  state       = 0; // holds the previous 'STATE'
-    unsigned char mpb_state   = 0; // master_push_button "who-done-it"
-    unsigned char mode        = 0; // for use in reaction 'fun' 
-        /*  Dbouncing:    */
-    volatile unsigned char *SFR;   // pointer to a special function register
-    unsigned char           BIT;   // bit(0-7) of 'SFR'
-    unsigned char sample_time = 0; // track when to sample 'BIT'
-    
 //***************************** MAINLOOP ***************************************    
     
     while(1) 
-    {        
-        // PROCESS LDR SENSOR INPUTS
-        /* Process collision detectors anytime Timer4 is running
-         *  i.e. if start_signal() has been called
-         */
-        if (TMR4IF == 1)
-        {   TMR4IF = 0; 
-            ++module;     
-            if (module >= 7)
-            {   module = 1;}
-            signal(module);     // signal() 1-6           
-        }
-        /* Only process wheel rotation sensors:
-         *  When Beetle is in active mode           (active == 1)
-         *  When there is no reaction taking place  (reaction == 0)
-         *  Every 3 Timer2 interrupts               (cc == 3)
-         */
-        if (do_mod_8 == 1) // process module 8 next time around mainloop
-        {   signal(8);
-            do_mod_8 = 0;
-        }
-        if (active == 1 && reaction == 0 && cc == 3)
-        {   signal(7);     // process module 7 now
-            cc = 0;
-            do_mod_8 = 1;
-        }
-                
-        // EVENT FLAGS  i.e. UPDATE 'STATE'  i.e. CHECK ALL SIGNALS
-            // remember the state of STATE before updating
-        state = STATE;
-            // * FRONT RIGHT
-        STATEbits.l1 = (LDR1 == 0)? (unsigned)0 : 1; 
-        STATEbits.p1 = (PB1 == 0)?  (unsigned)0 : 1; 
-        
-            // * FRONT MIDDLE
-        STATEbits.l2 = (LDR2 == 0)? (unsigned)0 : 1;
-       
-            // * FRONT LEFT
-        STATEbits.p2 = (PB2 == 0)?  (unsigned)0 : 1;
-        STATEbits.l3 = (LDR3 == 0)? (unsigned)0 : 1;
-        
-            // * BACK LEFT
-        STATEbits.l4 = (LDR4 == 0)? (unsigned)0 : 1;
-        STATEbits.p3 = (PB3 == 0)?  (unsigned)0 : 1;
-        
-            // * BACK MIDDLE
-        STATEbits.l5 = (LDR5 == 0)? (unsigned)0 : 1;
-        
-            // * BACK RIGHT
-        STATEbits.p4 = (PB4 == 0)?  (unsigned)0 : 1;
-        STATEbits.l6 = (LDR6 == 0)? (unsigned)0 : 1;
-        
-            // * RIGHT WHEEL STUCK
-        STATEbits.l7 = (LDR7 == 1)? (unsigned)0 : 1;
-        
-            // * LEFT WHEEL STUCK
-        STATEbits.l8 = (LDR8 == 1)? (unsigned)0 : 1;
-        
-            // * SOFTWARE SIGNAL 'END OF REACTION'
-        STATEbits.done = (bb == bb_stop)? (unsigned)1 : 0;
-        
-        
-        // PERFORM REACTIONS BASED ON 'STATE'
-        //      react only upon a change in STATE, if active
-        if (STATE != state && active == 1)
-        {   switch(STATE)
-            /* Each 'case' is a Reaction to an Event or combination of events 
-             *  which is deemed worthy of notice.
-             * All other input ('distractions') are sent straight to 'default'
-             *  and ignored.
-             * Reactions are first initialized with a "trigger" macro, in which
-             *  a non-0 value is given to 'bb_stop'; when 'bb' reaches this
-             *  value ('bb' increments in Timer2 Interrupt), the reaction is
-             *  continued or finished under 'case 4096'. 
-             *  This sequence can last as many times as necessary.
-             */
-            {   // no signal detected:
-                case 0:
-                    // this happens when STATE changes from non-0 to 0
-                    break;
-                // LDR1
-                case 1:
-                    trigger_front(1);
-                    break;
-                // PB1 & similar
-                case 2:   case 3:   case 5:   case 6:   case 7:   case 23: 
-                    trigger_front(2);
-                    break;
-                // LDR2 & similar
-                case 4:   case 21:
-                    trigger_front(4);
-                    break;
-                // PB2 & similar
-                case 8:   case 12:  case 20:  case 24:  case 28:  case 29:
-                    trigger_front(8);
-                    break;
-                // LDR3
-                case 16:
-                    trigger_front(16);
-                    break;                    
-                // LDR4
-                case 32:
-                    trigger_rear(32);
-                    break;                    
-                // PB3 & similar
-                case 64:  case 98:  case 160: case 192: case 224: case 736:
-                    trigger_rear(64);
-                    break;                    
-                // LDR5 & similar
-                case 128: case 672:
-                    trigger_rear(128);
-                    break;                
-                // PB4 & similar
-                case 256: case 384: case 640: case 768: case 896: case 928:
-                    trigger_rear(256);
-                    break;                    
-                // LDR6
-                case 512:
-                    trigger_rear(512);
-                    break;
-                // LDR7 (left wheel stuck), LDR8 (right wheel stuck), or both
-                case 1024:  case 2048:  case 3072:
-                    trigger_front(1024);   
-                    LDR7 = 1;
-                    LDR8 = 1;                 
-                    break;
-                    
-                // software signal "done"
-                case 4096:
-                    switch(reaction)
-                    {   // finish a collision reaction, having reversed                        
-                        case 2: case 4: case 8: case 64: case 128: case 256:
-                        case 1024:
-                            pivot(rand("direction"), rand("degree"));
-                            break;                            
-                        case 16: case 512:
-                            pivot('R', rand("degree"));
-                            break;                            
-                        case 1: case 32:
-                            pivot('L', rand("degree"));
-                            break;
-                        
-                        // go forward
-                        case 'g':
-                            bb_stop = 0;    // stop variable is out of reach
-                            LATC0 = 1;      // LED on
-                            move(1, "now"); // proceed forward
-                            reaction = 0;
-                            turntime = rand("time");
-                            break;
-                            
-                        // stop
-                        case 's':
-                            bb_stop = 0;
-                            LATC0 = 0;
-                            move(0, "now");
-                            break;
-                            
-                        // just for fun
-                        case 'f':
-                            // perform all move() modes, then stop and sing()
-                            move(mode, "wait");
-                            bb_stop = 410;
-                            if (mode == 0)  // time to stop
-                            {   reaction = 0;
-                                bb_stop = 0;
-                                sing("stop");
-                                active = 0;
-                            }
-                            mode++;
-                            if (mode >= 9)
-                            {   mode = 0;
-                            }
-                            break;
-                            
-                        default:    // shouldn't happen
-                            break;
-                    }
-                    // Do this if not finished yet
-                    if (reaction != 0 && reaction != 'f')
-                    {   reaction = 'g';     // finish next time
-                    }
-                    break;
-                    
-                // "hanging state"  i.e. signal 'done' + a hardware signal
-                case 4097:  case 4098:  case 4099:  case 4100:  case 4101:
-                case 4102:  case 4103:  case 4104:  case 4119:  case 4117:
-                case 4108:  case 4116:  case 4120:  case 4124:  case 4125:
-                case 4112:  case 4128:  case 4160:  case 4194:  case 4256:
-                case 4288:  case 4320:  case 4832:  case 4224:  case 4768:
-                case 4352:  case 4480:  case 4736:  case 4864:  case 4992:
-                case 5024:  case 4608:  case 5120:  case 6144:  case 7168:
-                           
-                    move(2, "wait");    // play it safe and reverse
-                    LDR7 = 1;
-                    LDR8 = 1;
-                    break;
-                    
-                // anything else  i.e. 'distractions'
-                default:
-                    break;
-            }
-        }
-        // A MECHANISM TO WAIT A MOMENT BEFORE MOVING
-        if (TMR2IF == 1 && waiting != 'n')
-        // while waiting: count Timer2 interrupt flags to keep track of time
-        {   TMR2IF = 0;
-            ++waiting; 
-            if (waiting == 40) // condition 'proceed' (~500 ms wait time)
-            // configure Timer2 interrupt now for move()
-            {   waiting = 'n';
-                // interrupt period = 1920 us (i.e. 15360 cyc)
-                T2CON = 0b00100111;        //[presc. = 1:16]; [postsc. = 1:5]
-                PR2 = 0xC0;                // decimal '192'
-                // interrupt enabled, flag LOW
-                TMR2IE = 1; 
-                TMR2IF = 0;
-                // enable motor logic inverter
-                IEN    = 1;
-            }
-        }        
-        // AFTER ~ 3 to 15 SECONDS OF SMOOTH DRIVING:
-        if (bb == turntime && active == 1 && reaction == 0)
-        // randomly turn or pivot
-        {   move(rand("move"), "now");
-            bb_stop = rand("degree");
-            reaction = 'g';
-        }
-        
-        // USER INTERFACE
-        /*  <Detect master pushbutton events> */
-        if (RBIF == 1)
-        {   // only initialize Dbounce routine if one is not already running
-            if (Dbounce_in_progress == 0)
-            {
-                // find out whether the culprit is PORTB6 or 7
-                mpb_state = (unsigned)(PORTB & 0xC0);
-
-                // PORTB6:
-                if (mpb_state == 0x40)
-                {   // Initialize de-bounce procedure for PORTB6
-                    Dbounce_ms(&PORTB, 6)
-                }
-                // PORTB7:
-                else if (mpb_state == 0x80)
-                {   // Initialize de-bounce procedure for PORTB7
-                    Dbounce_ms(&PORTB, 7)                        
-                }
-                // any other results  e.g. PORTB6 & 7 simultaneously:
-                //  do nothing
-                else {;}
-            }
-            // reset
-            RBIF = 0;
-        }        
-        /*  <De-bouncing & command execution> */
-        /*  'Dbounce_ms' works much like 'Dbounce_us' (located in 
-         *       MainFunctions.c) except that it is split into several pieces
-         *       which live in 'MAINLOOP()', instead of being in a single
-         *       function.
-         *      This is because it filters out any voltage spikes in the range
-         *       of a few milliseconds instead of a few hundred microseconds,
-         *       i.e. it needs more time to complete.
-         *  1) Initialization:
-         *      set '*SFR' and 'BIT' to point to the logic level bit in question
-         *      set up Timer6 and poll for its interrupt flag
-         *  2) Sampling:
-         *      sample bit 'BIT' of register 'SFR' every 'sample_time'
-         *       increments of TMR6
-         *  3) Results:
-         *      if 'BIT' always reads 'HIGH', then TMR6IF will be set and the
-         *          'Success' routine executed
-         *      if 'BIT' reads 'LOW' even once, then the 'FalseAlarm' routine
-         *          is executed
-         */ 
-        if (Dbounce_in_progress == 1)
-        {   
-            // <Success:> ('BIT' stayed consistently HIGH)
-            if (TMR6IF == 1)
-            {   // clean up
-                T6CON = 0x00;
-                TMR6 = 0x00;
-                TMR6IF = 0;
-                Dbounce_in_progress = 0;
-                
-                // MasterPushButton Commands------------------------------------
-                /*  PushButton1 (PORTB6)    */
-                if (BIT == 6)
-                {   // stop/start
-                    if (active == 0)        // currently stopped:
-                    {   start_signal();     //  start
-                        LATC0 = 1;
-                        sing("start");
-                        move(1, "now");
-                        active = 1;
-                        turntime = rand("time");
-                    }
-                    else if (active == 1)   // currently active:
-                    {   move(0, "now");     //  stop
-                        stop_signal();
-                        LATC0 = 0;
-                        sing("stop");
-                        bb_stop = 0;
-                        reaction = 0;
-                        active = 0;
-                        turntime = 0;
-                    }          
-                }
-                /*  PushButton2 (PORTB7)    */
-                else if (BIT == 7)
-                {   // stop if currently active
-                    if (active == 1)
-                    {   move(0, "now");
-                        stop_signal();
-                        LATC0 = 0;
-                        sing("stop");
-                        bb_stop = 0;
-                        reaction = 0;
-                        active = 0;
-                        turntime = 0;
-                    }
-                    // otherwise showcase what beetle can do
-                    else if (active == 0)
-                    {   sing("start");
-                        mode = 1;
-                        reaction = 'f'; // set reaction 'fun' in motion
-                        bb_stop = 1;    // trigger signal 'done'
-                        active = 1;
-                    }
-                }
-            }   //--------------------------------------------------------------
-            else
-            {   // ready for next sample?
-                if(TMR6 >= sample_time)
-                {   // sample 'BIT': if successful, set the next sample time 
-                    if ((*SFR & (1 << BIT)) != 0)
-                    {   // perform a sample ~ every 5 TMR6 increments
-                        //  i.e. 51 times out of 255 (~10 ms / 51)
-                        sample_time += 5;
-                    }
-                    // <False Alarm:> ('BIT' went LOW)
-                    else
-                    {   // clean up
-                        T6CON = 0x00;
-                        TMR6 = 0x00;
-                        Dbounce_in_progress = 0;
-                    }
-                }
-            }
-        }        
-        // MONITOR BATTERY LEVEL
-        if (C1IF == 1)
-        {   // attempt to rule out small voltage spikes
-            if (Dbounce_us(&CM2CON1, 7) == 1)
-            {   /* <Shutdown:>
-                 * stop any running processes;
-                 * make all pins digital outputs @ 0
-                 *  except make sure motors aren't sinking current;
-                 * SLEEP
-                 */
-                
-                move(0, "now");
-                sing("off");
-                
-                //Peripheral Module Disable: (stop the clock to all peripherals)
-                PMD0 = 0xFF;
-                PMD1 = 0xFF;
-                PMD2 = 0xFF;
-
-                // All pins LOW digital outputs
-                TRISA = 0x00;
-                TRISB = 0x00;
-                TRISC = 0x00;
-                ANSELA = 0x00;
-                ANSELB = 0x00;
-                ANSELC = 0x00;
-                LATA = 0x03;    // except for LA0 & LA1: HIGH digital outputs
-                LATB = 0x00;
-                LATC = 0x00;
-
-                SLEEP();
-            }            
-            C1IF = 0;
-        }
-        
+    {   events_take();
+        sched_run();
     } /*end of mainloop*/ 
     return 0;   // shouldn't happen
 }
@@ -0,0 +1,75 @@
+/*
+ * File:   adc.c  (host build)
+ *
+ * The stubbed ADC (see adc.h)
+ */
+
+#include "firmware.h"
+
+unsigned long adc_clock = 0;
+unsigned short (*adc_input)(unsigned char channel) = 0;
+
+static unsigned char going = 0;     // a conversion is in progress...
+static unsigned long started = 0;   //  ...since this time
+
+void host_adc_go(void)
+{
+    going   = 1;
+    started = adc_clock;
+}
+
+unsigned char host_adc_busy(void)
+/* (the firmware is waiting for the conversion: it's over) */
+{
+    if (going)
+    {   going = 0;
+        adc_clock += ADC_CONVERSION;
+    }
+    return 0;
+}
+
+unsigned short host_adc_result(void)
+{
+    return (adc_input != 0)? adc_input(ADCON0bits.CHS) : 0;
+}
+
+unsigned char host_adc_pending(void)
+{
+    return going;
+}
+
+void host_adc_run(unsigned long until)
+/* Finish every conversion due by 'until', each through the ADC interrupt
+ *  (which starts the next one asked for)
+ */
+{
+    while (going && started + ADC_CONVERSION <= until)
+    {   adc_clock = started + ADC_CONVERSION;
+        going = 0;
+        ADIF  = 1;
+        T2();
+    }
+}
+
+static unsigned short convert_value;
+
+static unsigned short convert_input(unsigned char channel)
+{
+    (void)channel;
+    return convert_value;
+}
+
+void host_adc_convert(unsigned char module_no, unsigned short value)
+/* Ask the scanner for a conversion of module 'module_no' (1-8) that reads
+ *  'value', and see it through to the module's 'RING' (start_signal() must
+ *  have been called)
+ */
+{
+    unsigned short (*input)(unsigned char) = adc_input;
+
+    convert_value = value;
+    adc_input = convert_input;
+    adc_scan(module_no);
+    host_adc_run(adc_clock + 1000);
+    adc_input = input;
+}
@@ -0,0 +1,38 @@
+/*
+ * File:   adc.h  (host build)
+ *
+ * The stubbed ADC: the scanner's hardware macros (see PhotoSensor.c) come
+ *  here instead of the ADC registers. A conversion asked for with ADC_GO()
+ *  reads whatever 'adc_input' says the channel is at, 'adc_clock' us after
+ *  the start; it takes ADC_CONVERSION us, and is finished by 'host_adc_run()'
+ *  (which raises the ADC interrupt), or at once by ADC_BUSY() when the
+ *  firmware waits on it. 'host_adc_convert()' puts a single value through
+ *  the scanner, for tests.
+ * TMR1 runs at 1 us a tick, and the signal LED's (CCP2) toggle each time it
+ *  overflows, so both follow from 'adc_clock'.
+ */
+
+#ifndef HOST_ADC_H
+#define HOST_ADC_H
+
+#define ADC_CONVERSION 25       // us, interrupt included
+
+extern unsigned long adc_clock;     // us since the start
+// what channel 'channel' reads at the moment
+extern unsigned short (*adc_input)(unsigned char channel);
+
+void           host_adc_go(void);
+unsigned char  host_adc_busy(void);
+unsigned short host_adc_result(void);
+unsigned char  host_adc_pending(void);
+void           host_adc_run(unsigned long until);
+void           host_adc_convert(unsigned char module_no, unsigned short value);
+
+#define ADC_RESULT()    host_adc_result()
+#define ADC_TIME(t)     do { t = (unsigned short)adc_clock; } while (0)
+#define ADC_LED()       ((unsigned char)((adc_clock >> 16) & 1))
+#define ADC_CHANNEL(c)  (ADCON0bits.CHS = (c))
+#define ADC_GO()        host_adc_go()
+#define ADC_BUSY()      host_adc_busy()
+
+#endif  /* HOST_ADC_H */
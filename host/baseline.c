@@ -0,0 +1,244 @@
+/*
+ * File:   baseline.c  (host build)
+ *
+ * The stationary point search of 'signal()' (PhotoSensor.c) as it was before
+ *  'LDRSIG' and 'GRDNT' were packed: 21 entry circular queues of samples and
+ *  gradients, indexed around 'MID'. The rest (calibration, the wheel speed
+ *  estimate, the stall test) is as the firmware has it now, so the two
+ *  should report exactly the same.
+ *  With 'summing' set, the slopes either side of 'MID' are added up afresh
+ *  with two loops every call, as they were before 'SLOPE' kept running
+ *  totals; otherwise 'SLOPE' is kept as in the firmware.
+ *
+ * Built like the firmware (with <xc.h>, so int is 16 bits); see baseline.h.
+ */
+
+#include <xc.h>
+#include "beetle.h"
+
+#define SPNTS_SLOPE     5
+#define SPNTS_SLOPE_MIN 3
+#define CAL_SAMPLES     64
+#define CAL_ADAPT       3
+#define CAL_SLOPE       5
+#define CAL_FLOOR       12
+#define WHEEL_NOMINAL   275
+
+struct calib
+{   unsigned int  sum, noise, floor;
+    signed char   slope;
+    unsigned char samples, blocks;
+};
+struct spnts
+{   unsigned int v_level;
+    char         count;
+};
+static struct module
+{   unsigned int  count;
+    signed char   MID;
+    unsigned int  LDRSIG[21];
+    signed char   GRDNT[21];
+    struct spnts  SPNTS[2];
+    signed char   L, R;
+    struct calib  CAL;
+    unsigned int  interval;
+}   MODULE[2][8];     // [summing]: each way keeps its own
+
+unsigned int BASELINE_LDR[2][8], BASELINE_WHEEL[2][8];
+
+void baseline_reset(void)
+{
+    unsigned char i, j;
+    struct module *m;
+
+    for (i = 0; i < 16; i++)
+    {   m = &MODULE[i >> 3][i & 7];
+        m->count = 0;
+        m->MID   = 10;
+        for (j = 0; j < 21; j++)
+        {   m->LDRSIG[j] = 0;
+            m->GRDNT[j]  = 0;
+        }
+        m->SPNTS[0].v_level = 0;
+        m->SPNTS[0].count   = 0;
+        m->SPNTS[1].v_level = 0;
+        m->SPNTS[1].count   = 0;
+        m->L = 0;
+        m->R = 0;
+        m->interval = 0;
+        // as 'start_signal()'
+        m->CAL.sum     = 0;
+        m->CAL.floor   = 0;
+        m->CAL.slope   = SPNTS_SLOPE;
+        m->CAL.samples = CAL_SAMPLES + 1;
+        m->CAL.blocks  = 0;
+        // as main.c
+        BASELINE_LDR[i >> 3][i & 7]   = ((i & 7) >= 6)? 1 : 0;
+        BASELINE_WHEEL[i >> 3][i & 7] = 0;
+    }
+}
+
+static void calibrate(struct calib *CAL, unsigned int diff, unsigned int SIGNAL)
+{
+    unsigned int noise;
+    signed int   slope;
+
+    if (SIGNAL != 0)
+    {   CAL->sum     = 0;
+        CAL->samples = CAL_SAMPLES;
+        return;
+    }
+    if (CAL->samples <= CAL_SAMPLES)
+    {   CAL->sum += diff;   }
+    if (--CAL->samples != 0)
+    {   return; }
+
+    noise = CAL->sum / (CAL_SAMPLES / 16);
+    if (CAL->blocks == 0)
+    {   CAL->noise  = noise;
+        CAL->blocks = 1;
+    }
+    else
+    {   CAL->noise += ((signed int)noise - (signed int)CAL->noise) >> CAL_ADAPT;
+    }
+    CAL->sum     = 0;
+    CAL->samples = CAL_SAMPLES;
+
+    slope = SPNTS_SLOPE - (signed int)(CAL->noise >> CAL_SLOPE);
+    CAL->slope = (slope < SPNTS_SLOPE_MIN)? SPNTS_SLOPE_MIN : (signed char)slope;
+    CAL->floor = ((CAL->noise >> 2) * CAL_FLOOR) >> 2;
+}
+
+void baseline_sample(unsigned char module_no, unsigned int value, bit summing)
+/* feed one sample to module 'module_no' (1-8) */
+{
+    struct module *m      = &MODULE[summing][module_no - 1];
+    unsigned int  *SIGNAL = &BASELINE_LDR[summing][module_no - 1];
+    unsigned char  wheel  = (module_no >= 7);
+    unsigned char  n, p;
+    signed char    g_mid, g_old, L, R;
+    signed int     j, k;
+    char           SIG_D = 0;
+
+    g_mid = m->GRDNT[m->MID];
+    if (m->MID >= 20)
+        m->MID = 0;
+    else
+        m->MID += 1;
+    n = (m->MID <= 10)? (m->MID + 10) : (m->MID - 11);
+    p = (n == 0)? 20 : (n-1);
+    g_old = m->GRDNT[n];
+
+    if (wheel == 0)
+    {   calibrate(&m->CAL, (m->LDRSIG[p] > value)? (m->LDRSIG[p] - value) :
+                                                   (value - m->LDRSIG[p]), *SIGNAL);
+    }
+    m->LDRSIG[n] = value;
+    if      (m->LDRSIG[p] < m->LDRSIG[n])
+    {   m->GRDNT[p] = 1;    }
+    else if (m->LDRSIG[p] > m->LDRSIG[n])
+    {   m->GRDNT[p] = -1;   }
+    else
+    {   m->GRDNT[p] = 0;    }
+
+    if (summing == 0)
+    {   m->L += g_mid - g_old;
+        m->R += m->GRDNT[p] - g_mid;
+    }
+
+    switch (m->count)
+    {
+        case 0: case 1: case 2: case 3: case 4: case 5: case 6:
+        case 7: case 8: case 9: case 10: case 11:
+        {   ++(m->count);
+            break;
+        }
+        default:
+        {
+            if (summing == 1)
+            {   // the 10 GRDNT points older than 'MID'
+                L = 0;
+                j = (m->MID <= 9)? (m->MID + 11) : (m->MID - 10);
+                while (j != m->MID)
+                {   L += m->GRDNT[j];
+                    j++;
+                    j = (j > 20)? (j-21) : j;
+                }
+                // the 10 GRDNT points equal to and newer than 'MID'
+                R = 0;
+                j = m->MID;
+                k = (m->MID >= 11)? (m->MID - 11) : (m->MID + 10);
+                while (j != k)
+                {   R += m->GRDNT[j];
+                    j++;
+                    j = (j > 20)? (j-21) : j;
+                }
+            }
+            else
+            {   L = m->L;
+                R = m->R;
+            }
+
+            if (((L > m->CAL.slope) && (R < -m->CAL.slope)) ||
+                ((L < -m->CAL.slope) && (R > m->CAL.slope)))
+            {
+                m->SPNTS[0] = m->SPNTS[1];
+                m->SPNTS[1].v_level = m->LDRSIG[11];
+                m->SPNTS[1].count = m->count;
+
+                if (wheel == 1)
+                {   *SIGNAL = 1;
+                    if (m->SPNTS[0].count != 0)
+                    {   k = (m->count + 1) << 4;
+                        if (m->interval == 0)
+                        {   m->interval = k;  }
+                        else
+                        {   m->interval += (k - (signed int)m->interval) >> 2;
+                        }
+                        BASELINE_WHEEL[summing][module_no - 1] = m->interval * 6;
+                    }
+                }
+                else
+                {   for (j = 0; j <= 1; j++)
+                    {   if ((m->SPNTS[j].count) < 18 || (m->SPNTS[j].count) > 25)
+                        {   SIG_D = 0;  }
+                        else
+                        {   ++SIG_D;    }
+                    }
+                    if (SIG_D == 2)
+                    {   if (m->SPNTS[0].v_level > m->SPNTS[1].v_level)
+                        {   k = (m->SPNTS[0].v_level - m->SPNTS[1].v_level);  }
+                        else
+                        {   k = (m->SPNTS[1].v_level - m->SPNTS[0].v_level);  }
+                        if (k > m->CAL.floor)
+                        {   *SIGNAL = k;    }
+                    }
+                }
+                m->count = 0;
+            }
+            else
+            {   ++(m->count); }
+            break;
+        }
+    }
+
+    if (wheel == 1)
+    {   k = ((m->interval == 0)? WHEEL_NOMINAL : m->interval) >> 3;
+        if (m->count > k && bb > 3 * k)
+        {   *SIGNAL = 0;    }
+    }
+
+    if (m->count >= 42)
+    {   for (j = 0; j < 2; j++)
+        {   m->SPNTS[j].v_level = 0;
+            m->SPNTS[j].count   = 0;
+        }
+        if (wheel == 1)
+        {   if (bb > 3 * 42)
+            {   *SIGNAL = 0;  }
+        }
+        else
+        {   *SIGNAL = 0;    }
+        m->count = 0;
+    }
+}
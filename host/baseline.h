@@ -0,0 +1,18 @@
+/*
+ * File:   baseline.h  (host build)
+ *
+ * The stationary point search with its old 21 entry queues (see baseline.c).
+ *  Include after firmware.h.
+ */
+
+#ifndef HOST_BASELINE_H
+#define HOST_BASELINE_H
+
+// LDRx & WHEELx as the baseline has them: [summing][module_no - 1]
+extern unsigned short BASELINE_LDR[2][8], BASELINE_WHEEL[2][8];
+
+void baseline_reset(void);
+void baseline_sample(unsigned char module_no, unsigned short value,
+                     unsigned char summing);
+
+#endif  /* HOST_BASELINE_H */
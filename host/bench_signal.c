@@ -0,0 +1,108 @@
+/*
+ * File:   bench_signal.c  (host build)
+ *
+ * Cost of the stationary point search per sample, three ways, on the same
+ *  samples (see baseline.c):
+ *  - "summing":  21 entry queues, slopes added up with two loops every call
+ *  - "SLOPE":    21 entry queues, running slope totals
+ *  - "signal()": the firmware as it is (packed history, running totals),
+ *                including the trip through the module's 'RING'
+ * All three must report the same LDRx & WHEELx after every sample, or this
+ *  fails. Times are host CPU cycles (see clock.h) less the cost of reading
+ *  the clock: they compare the versions, they aren't PIC cycles.
+ *
+ *  bench_signal [samples per module]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "clock.h"
+#include "firmware.h"
+#include "baseline.h"
+
+static unsigned short *const LDR[8] =
+{   &LDR1, &LDR2, &LDR3, &LDR4, &LDR5, &LDR6, &LDR7, &LDR8
+};
+
+static unsigned long seed = 1;
+
+static int noise(int size)
+/* -size to +size */
+{
+    seed = seed * 1103515245 + 12345;
+    return (int)((seed >> 16) % (2 * size + 1)) - size;
+}
+
+static unsigned short sample(int module, long n)
+/* the 'n'th sample of module 'module' (1-8): every 3.12 ms for the collision
+ *  detectors, with an object reflecting the LED's every other 2 s; every
+ *  4.2 ms for the wheels, which stall every other 3 s
+ */
+{
+    static double led[9];
+    double t, v;
+
+    if (module <= 6)
+    {   t = n * 3120e-6;
+        led[module] += ((((long)(t * 1e6) >> 16) & 1) - led[module]) * 0.12;
+        v = 500 + 40 * sin(t / 3) + noise(2);
+        if (((long)t / 2) % 2 == 1)
+        {   v += (10 * module) * led[module];   }
+    }
+    else
+    {   t = n * 4200e-6;
+        v = 500 + noise(2);
+        if (((long)t / 3) % 2 == 0)
+        {   v += 60 * cos(2 * M_PI * t / 0.144);    }
+    }
+    return (unsigned short)v;
+}
+
+int main(int argc, char **argv)
+{
+    long samples = (argc > 1)? atol(argv[1]) : 200000, n;
+    unsigned long long t0, t1, overhead, cost[3] = {0, 0, 0};
+    unsigned long mismatch = 0;
+    unsigned short v;
+    int m, i;
+
+    overhead = clock_overhead();
+
+    TMR1IF = 1;
+    start_signal();
+    baseline_reset();
+    bb = 1000;          // well into a movement: the stall test is live
+
+    for (m = 1; m <= 8; m++)
+    {   for (n = 0; n < samples; n++)
+        {   v = sample(m, n);
+
+            for (i = 0; i < 2; i++)
+            {   t0 = clock_now();
+                baseline_sample(m, v, !i);
+                t1 = clock_now();
+                cost[i] += t1 - t0 - overhead;
+            }
+            host_adc_convert(m, v);
+            t0 = clock_now();
+            signal(m);
+            t1 = clock_now();
+            cost[2] += t1 - t0 - overhead;
+
+            for (i = 0; i < 2; i++)
+            {   if (*LDR[m - 1] != BASELINE_LDR[i][m - 1] ||
+                    (m == 7 && WHEEL7 != BASELINE_WHEEL[i][6]) ||
+                    (m == 8 && WHEEL8 != BASELINE_WHEEL[i][7]))
+                {   ++mismatch; }
+            }
+        }
+    }
+    printf("%ld samples per module, %s per sample:\n", samples, UNIT);
+    for (i = 0; i < 3; i++)
+    {   printf("  %-9s %6.1f\n", (i == 0)? "summing" : (i == 1)? "SLOPE" : "signal()",
+               (double)cost[i] / (8 * samples));
+    }
+    printf("mismatches: %lu\n", mismatch);
+    return mismatch != 0;
+}
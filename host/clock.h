@@ -0,0 +1,42 @@
+/*
+ * File:   clock.h  (host build)
+ *
+ * A fine clock for timing firmware code on the PC: host CPU cycles (the x86
+ *  TSC), or ns elsewhere. 'clock_overhead()' is what reading it costs, to
+ *  take off each measurement. Host cycles compare versions of the code with
+ *  each other; they aren't PIC cycles.
+ */
+
+#ifndef HOST_CLOCK_H
+#define HOST_CLOCK_H
+
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define UNIT "cycles"
+static unsigned long long clock_now(void) { return __rdtsc(); }
+#else
+#define UNIT "ns"
+static unsigned long long clock_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+#endif
+
+static unsigned long long clock_overhead(void)
+{
+    unsigned long long t0, t1, overhead = ~0ULL;
+    long n;
+
+    for (n = 0; n < 100000; n++)
+    {   t0 = clock_now();
+        t1 = clock_now();
+        if (t1 - t0 < overhead)
+        {   overhead = t1 - t0; }
+    }
+    return overhead;
+}
+
+#endif  /* HOST_CLOCK_H */
@@ -0,0 +1,38 @@
+/*
+ * File:   firmware.h  (host build)
+ *
+ * The firmware as host code sees it: its registers (xc.h), its globals
+ *  (beetle.h), and the functions the harness and tests call. Include after
+ *  any system headers; 'int' is XC8's 16-bit one only up to the end of this
+ *  file.
+ */
+
+#ifndef HOST_FIRMWARE_H
+#define HOST_FIRMWARE_H
+
+#include "int16.h"
+#include "xc.h"
+#include "beetle.h"
+
+// sensory
+void          start_signal(void);
+void          stop_signal(void);
+void          signal_gate(void);
+void          signal(unsigned char);
+void          adc_scan(unsigned char);
+void          adc_done(void);
+// motor control
+void          move(char, unsigned int, when_t);
+void          arc(char, unsigned int, unsigned int, unsigned int);
+unsigned int  rand(rand_t);
+unsigned int  rand_word(void);
+unsigned int  rand_range(unsigned int, unsigned int);
+// main
+unsigned char power_update(unsigned char);
+bit           event_get(struct event *);
+void          T2(void);
+unsigned int  state_event(unsigned int);
+
+#undef int
+
+#endif  /* HOST_FIRMWARE_H */
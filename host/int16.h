@@ -0,0 +1,12 @@
+/*
+ * File:   int16.h  (host build)
+ *
+ * XC8's int is 16 bits: so is the firmware's here, wrap-arounds and all.
+ *
+ * The Makefile forces this in ahead of each firmware source (-include), none
+ *  of which include a system header. Host code gets it from firmware.h, which
+ *  comes after its system headers and takes 'int' back at its end; so there's
+ *  no include guard, for it to be picked up again.
+ */
+
+#define int short
@@ -0,0 +1,7 @@
+/*
+ * File:   pic18f26k22.h  (host build)
+ *
+ * main.c names the device header as well as <xc.h>; here they are one.
+ */
+
+#include "xc.h"
@@ -0,0 +1,245 @@
+/*
+ * File:   replay.c  (host build)
+ *
+ * Replays a trace of the eight photosensor inputs through the firmware's own
+ *  ADC scanner and 'signal()', on the PC, and reports how well each module
+ *  picked out what was there.
+ *
+ *  replay [-p ms] [-s] [trace]     (the trace comes from stdin if not named)
+ *
+ * A trace is lines of
+ *      <time, us>  <module 1> ... <module 8>  [<truth>]
+ *  each input being an ADC count (0-1023) held from that time until the next
+ *  line; '#' starts a comment. 'truth' has bit 'i' set while module 'i + 1'
+ *  ought to be signalling: an object in front of a collision detector, or a
+ *  wheel stuck. Without it, every detection is a false positive (e.g. for a
+ *  trace recorded with nothing in front of the bumpers).
+ *
+ * Timer4 and the ADC interrupt run as on the PIC (see adc.h), and so does
+ *  Timer2 with Beetle driving forward (unless -s: standing still, when the
+ *  wheel sensors aren't sampled). Every 1.024 ms, as TASK_SENSE would,
+ *  'signal()' takes whatever samples have come in. For each module it
+ *  reports:
+ *  - events: how many times 'truth' came on, and of those, how many were
+ *      found before it went off again, and how long that took (latency)
+ *  - false positives: detections that began while 'truth' was off
+ *  - strength: the average LDRx while rightly detecting (modules 1-6)
+ * With -p, LDR1-8 and WHEEL7-8 are also printed every 'ms' milliseconds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "firmware.h"
+
+#define SENSE_PERIOD 1024   // us (a Timer0 tick)
+#define T4_PERIOD    520    // us
+#define BATTERY      512    // AN9 reads 2.5 v: charged
+
+// the ADC channel of each module, as in 'DESCRIPTOR[]'
+static const unsigned char CHANNEL[8] =
+{   0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x04, 0x0D
+};
+static unsigned short *const LDR[8] =
+{   &LDR1, &LDR2, &LDR3, &LDR4, &LDR5, &LDR6, &LDR7, &LDR8
+};
+
+static unsigned short level[8];     // the inputs now
+
+static unsigned short input(unsigned char channel)
+{
+    int i;
+
+    for (i = 0; i < 8; i++)
+    {   if (CHANNEL[i] == channel)
+        {   return level[i];    }
+    }
+    return BATTERY;
+}
+
+// what each module has done so far
+static struct score
+{   int           truth, asserted;      // as at the last look
+    unsigned long onset;                // when 'truth' last came on
+    int           pending;              //  ...and it hasn't been found yet
+    int           events, found;
+    unsigned long latency, worst;       // us: total & longest
+    int           false_pos;
+    unsigned long strength, looks;      // LDRx summed while rightly detecting
+}   SCORE[8];
+
+static void look(unsigned long now, unsigned truth)
+/* check each module's LDRx against 'truth' */
+{
+    int i, t, a;
+    struct score *s;
+
+    for (i = 0; i < 8; i++)
+    {   s = &SCORE[i];
+        t = (truth >> i) & 1;
+        a = (i < 6)? (*LDR[i] != 0) : (*LDR[i] == 0);
+
+        if (t && !s->truth)
+        {   s->onset   = now;
+            s->pending = 1;
+            ++s->events;
+        }
+        if (!t && s->truth)
+        {   s->pending = 0;     // missed, if still pending
+        }
+        if (a && t && s->pending)
+        {   s->pending = 0;
+            ++s->found;
+            s->latency += now - s->onset;
+            if (now - s->onset > s->worst)
+            {   s->worst = now - s->onset;  }
+        }
+        if (a && !s->asserted && !t)
+        {   ++s->false_pos;     }
+        if (a && t && i < 6)
+        {   s->strength += *LDR[i];
+            ++s->looks;
+        }
+        s->truth    = t;
+        s->asserted = a;
+    }
+}
+
+static void report(unsigned long end)
+{
+    int i;
+    struct score *s;
+
+    printf("# %.1f s replayed\n", end / 1e6);
+    printf("module  events  found  latency ms (mean   max)  false pos.  strength\n");
+    for (i = 0; i < 8; i++)
+    {   s = &SCORE[i];
+        printf("LDR%d    %6d  %5d", i + 1, s->events, s->found);
+        if (s->found != 0)
+        {   printf("           %6.1f %6.1f", s->latency / 1e3 / s->found,
+                   s->worst / 1e3);
+        }
+        else
+        {   printf("                %6s", "-");  }
+        printf("  %10d", s->false_pos);
+        if (s->looks != 0)
+        {   printf("  %8.1f", (double)s->strength / s->looks);   }
+        printf("\n");
+    }
+}
+
+static int row(FILE *f, unsigned long *t, unsigned short v[8], unsigned *truth)
+/* read the next line of the trace; 0 at the end */
+{
+    char line[256];
+    unsigned long x[10];
+    int n, i;
+
+    while (fgets(line, sizeof line, f) != NULL)
+    {   if (line[0] == '#' || line[0] == '\n')
+        {   continue;   }
+        n = sscanf(line, "%lu %lu %lu %lu %lu %lu %lu %lu %lu %lu", &x[0],
+                   &x[1], &x[2], &x[3], &x[4], &x[5], &x[6], &x[7], &x[8], &x[9]);
+        if (n < 9)
+        {   fprintf(stderr, "replay: bad trace line: %s", line);
+            exit(2);
+        }
+        *t = x[0];
+        for (i = 0; i < 8; i++)
+        {   v[i] = (unsigned short)((x[i + 1] > 1023)? 1023 : x[i + 1]);    }
+        *truth = (n == 10)? (unsigned)x[9] : 0;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *f = stdin;
+    unsigned long period = 0, print_at = 0, now = 0;
+    unsigned long t4 = T4_PERIOD, t2 = 0, sense = SENSE_PERIOD, next;
+    unsigned short v[8];
+    unsigned truth = 0, truth_next = 0;
+    int still = 0, more, c, i;
+    struct event ev;
+
+    while ((c = getopt(argc, argv, "p:s")) != -1)
+    {   switch (c)
+        {   case 'p': period = strtoul(optarg, NULL, 10) * 1000; break;
+            case 's': still = 1; break;
+            default:
+                fprintf(stderr, "usage: replay [-p ms] [-s] [trace]\n");
+                return 2;
+        }
+    }
+    if (optind < argc && (f = fopen(argv[optind], "r")) == NULL)
+    {   perror(argv[optind]);
+        return 2;
+    }
+    if (!row(f, &next, level, &truth))
+    {   fprintf(stderr, "replay: empty trace\n");
+        return 2;
+    }
+    more = row(f, &next, v, &truth_next);
+
+    adc_input = input;
+    TMR1IF = 1;         // (an LED period gone: start_signal() starts at once)
+    start_signal();
+    if (!still)
+    {   move(1, 0, MOVE_NOW);
+        t2 = PR2 * 10;
+    }
+
+    while (1)
+    {   // the next thing to happen
+        now = t4;
+        if (t2 != 0 && t2 < now)   now = t2;
+        if (sense < now)           now = sense;
+        if (more && next <= now)   now = next;
+
+        host_adc_run(now);
+        adc_clock = now;
+
+        if (more && now == next)
+        {   memcpy(level, v, sizeof level);
+            truth = truth_next;
+            more = row(f, &next, v, &truth_next);
+            if (more && next < now)
+            {   fprintf(stderr, "replay: trace goes back in time\n");
+                return 2;
+            }
+        }
+        if (now == t4)
+        {   TMR4IF = 1;
+            T2();
+            t4 += T4_PERIOD;
+        }
+        if (now == t2)
+        {   TMR2IF = 1;
+            T2();
+            t2 = (TMR2IE == 1)? now + PR2 * 10 : 0;
+        }
+        if (now == sense)
+        {   while (event_get(&ev))
+            {;}
+            for (i = 1; i <= 8; i++)
+            {   if (i <= 6 || !still)
+                {   signal(i);  }
+            }
+            look(now, truth);
+            if (period != 0 && now >= print_at)
+            {   printf("%8.1f", now / 1e3);
+                for (i = 0; i < 8; i++)
+                {   printf(" %4u", *LDR[i]);    }
+                printf(" %5u %5u\n", WHEEL7, WHEEL8);
+                print_at += period;
+            }
+            sense += SENSE_PERIOD;
+            if (!more)
+            {   break;  }
+        }
+    }
+    report(now);
+    return 0;
+}
@@ -0,0 +1,30 @@
+/*
+ * File:   sfr.c  (host build)
+ *
+ * The special function registers of xc.h, and the firmware variables that
+ *  XC8 places at fixed addresses
+ */
+
+#include "firmware.h"
+
+volatile unsigned char
+    ADCON1, ADCON2, ADRESH, ADRESL,
+    ANSELA, ANSELB, ANSELC, TRISA, TRISB, TRISC, LATB, PORTB,
+    OSCCON, PMD0, PMD1, PMD2,
+    T0CON, T1CON, T2CON, T3CON, T4CON, T5CON, PR2, PR4,
+    TMR0L, TMR1L, TMR1H, TMR3L, TMR3H, TMR5L, TMR5H,
+    CCPTMRS0, CCP2CON, CCP4CON, CCP5CON,
+    CCPR2L, CCPR2H, CCPR4L, CCPR4H, CCPR5L, CCPR5H;
+
+volatile host_port_t         host_LATA, host_LATC;
+volatile host_PORTCbits_t    host_PORTCbits;
+volatile host_ADCON0bits_t   host_ADCON0bits;
+volatile host_CCPTMRS1bits_t host_CCPTMRS1bits;
+
+volatile unsigned char
+    GIEH, GIEL, IPEN, PLLEN, TRISC1, ADON, GO_nDONE, ADIE, ADIF,
+    TMR0IE, TMR0IF, TMR1IF, TMR2IE, TMR2IF, TMR2IP, TMR2ON, TMR3ON,
+    TMR4IE, TMR4IF, TMR5IF, TMR5ON, CCP4IE, CCP4IF, CCP5IE, CCP5IF;
+
+// (STATE & STATEbits share an address on the PIC; not here)
+volatile STATEbits_t STATEbits;
@@ -0,0 +1,106 @@
+/*
+ * File:   synth.c  (host build)
+ *
+ * Writes a synthetic photosensor trace for 'replay' (see replay.c): every
+ *  STEP us, what each of the 8 modules would read, and the truth.
+ *
+ *  synth [-d seconds] [-n noise] [-r seed]
+ *
+ * Collision detectors (1-6) read their ambient light level, drifting slowly,
+ *  plus noise of up to +/- 'noise' ADC counts. While an object is in front of
+ *  one (see 'SCENE[]'), the light of the signal LED's is reflected into it
+ *  as well: a 7.63 Hz square wave, rounded off by the photoresistor.
+ * Wheel rotation sensors (7 & 8) see a hex bolt head turning at the speed
+ *  Beetle cruises at (one face per 144 ms), unless that wheel is stuck.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define STEP      100       // us between lines
+#define LED_HALF  65536     // us: TMR1 overflows, and CCP2 toggles
+#define LDR_TAU   25000.0   // us: photoresistor response time
+#define FACE      144000.0  // us per hex face, cruising
+
+// what happens, and when: module (1-8), from & to (s), and for modules 1-6
+//  the peak to peak of the reflected LED light (ADC counts)
+static const struct scene
+{   int    module;
+    double from, to;
+    double amplitude;
+}   SCENE[] =
+{   {1,  2.0,  3.5, 40},
+    {2,  5.0,  6.0, 24},
+    {3,  7.5,  9.5, 60},
+    {7,  8.0,  9.0,  0},    // M1 wheel stuck
+    {4, 11.0, 12.5, 30},
+    {5, 13.5, 15.0, 20},
+    {8, 14.0, 15.0,  0},    // M2 wheel stuck
+    {6, 16.5, 18.0, 50},
+    {1, 19.0, 20.5, 16},    // faint
+    {3, 19.0, 20.5, 45},    //  ...while another module sees it plainly
+};
+#define SCENES (sizeof(SCENE) / sizeof(SCENE[0]))
+
+static double noise(double size)
+/* triangular, -size to +size */
+{
+    return size * ((double)rand() / RAND_MAX - (double)rand() / RAND_MAX);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 22, size = 2, led = 0, s, v;
+    double ambient[6] = {420, 515, 380, 610, 470, 540};
+    unsigned long t, end;
+    unsigned truth;
+    unsigned c, i, k;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:n:r:")) != -1)
+    {   switch (opt)
+        {   case 'd': seconds = atof(optarg); break;
+            case 'n': size = atof(optarg); break;
+            case 'r': srand(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: synth [-d seconds] [-n noise] [-r seed]\n");
+                return 2;
+        }
+    }
+    end = (unsigned long)(seconds * 1e6);
+
+    printf("# synth: %.1f s, noise +/- %.1f\n", seconds, size);
+    for (t = 0; t < end; t += STEP)
+    {   s = t / 1e6;
+        // the LED's through the photoresistor's lag
+        led += (((t / LED_HALF) & 1) - led) * (STEP / LDR_TAU);
+
+        truth = 0;
+        printf("%lu", t);
+        for (i = 0; i < 8; i++)
+        {   c = 0;
+            for (k = 0; k < SCENES; k++)
+            {   if (SCENE[k].module == (int)i + 1 &&
+                    s >= SCENE[k].from && s < SCENE[k].to)
+                {   c = k + 1;  }
+            }
+            if (c != 0)
+            {   truth |= 1u << i;   }
+
+            if (i < 6)
+            {   v = ambient[i] + 30 * sin(s / (3 + i)) + noise(size);
+                if (c != 0)
+                {   v += SCENE[c - 1].amplitude * led;  }
+            }
+            else if (c == 0)
+            {   v = 500 + 60 * cos(2 * M_PI * t / FACE) + noise(size);   }
+            else
+            {   v = 440 + noise(size);  }
+            printf(" %d", (int)lround(v));
+        }
+        printf(" %u\n", truth);
+    }
+    return 0;
+}
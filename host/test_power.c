@@ -0,0 +1,160 @@
+/*
+ * File:   test_power.c  (host build)
+ *
+ * The power modes of MainFunctions.c, PhotoSensor.c and MotorControl.c:
+ *  - 'power_update()' steps down a mode as the (averaged) battery level falls
+ *    below each of BATT_SAVE, BATT_LOW & BATT_EMPTY, and only back up once it
+ *    is BATT_HYST over the threshold again; POWER_OFF is for good. 'ramp_top',
+ *    'current_trim' and 'battery_soc' must follow.
+ *  - 'signal_gate()' drives the signal LED's for 16, 12 or 8 of every 16
+ *    calls, in one stretch, and leaves them be in POWER_OFF.
+ *  - 'arc()' stretches both full-step periods by 1/8 a mode below POWER_FULL
+ *    (M1 no slower than PR2 allows, M2 keeping the ratio), and trims L0 & L1.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "firmware.h"
+
+static const unsigned char RAMP_MAX[POWER_OFF] = {18, 10, 4};
+static const unsigned char BATT[POWER_OFF] = {BATT_SAVE, BATT_LOW, BATT_EMPTY};
+
+static int fail = 0;
+
+static void settle(unsigned char level)
+/* let 'power_update()' average its way to 'level' */
+{
+    int n;
+
+    for (n = 0; n < 64; n++)
+    {   power_update(level);    }
+}
+
+static void expect(unsigned char level, unsigned char mode, const char *way)
+/* 'power' and what goes with it, at 'level' on the way 'way' */
+{
+    unsigned soc = (level <= BATT_EMPTY)? 0 : (level >= BATT_FULL)? 100 :
+                   (level - BATT_EMPTY) * 100 / (BATT_FULL - BATT_EMPTY);
+
+    if (power != mode)
+    {   printf("FAIL: level %u %s: power %u, not %u\n", level, way, power, mode);
+        ++fail;
+    }
+    else if (mode < POWER_OFF && (ramp_top != RAMP_MAX[mode] ||
+             current_trim != ((mode == POWER_FULL)? 0x00 : 0x01)))
+    {   printf("FAIL: level %u %s: power %u with ramp_top %u, current_trim %u\n",
+               level, way, mode, ramp_top, current_trim);
+        ++fail;
+    }
+    if (battery_soc != soc)
+    {   printf("FAIL: level %u: battery_soc %u, not %u\n", level, battery_soc, soc);
+        ++fail;
+    }
+}
+
+static void thresholds(void)
+/* down from full to just above empty, back up, and then down to off */
+{
+    unsigned level, mode;
+
+    for (level = BATT_FULL + 4; level > BATT_EMPTY; level--)
+    {   settle(level);
+        for (mode = POWER_FULL; mode < POWER_OFF && level < BATT[mode]; mode++)
+        {;}
+        expect(level, mode, "falling");
+    }
+    for (level = BATT_EMPTY; level <= BATT_FULL + 4; level++)
+    {   settle(level);
+        for (mode = POWER_LOW; mode > POWER_FULL &&
+                               level >= (unsigned)BATT[mode - 1] + BATT_HYST; mode--)
+        {;}
+        expect(level, mode, "rising");
+    }
+    settle(BATT_EMPTY - 1);
+    expect(BATT_EMPTY - 1, POWER_OFF, "falling");
+    settle(BATT_FULL);
+    expect(BATT_FULL, POWER_OFF, "after POWER_OFF");
+}
+
+static void duty(void)
+/* LED's driven for how many of every 16 'signal_gate()' calls, in each mode */
+{
+    static const unsigned ON[POWER_OFF + 1] = {16, 12, 8, 16};
+    unsigned mode, n, on, edges;
+    unsigned char was;
+
+    ADIE = 1;           // (the scanner is running)
+    for (mode = POWER_FULL; mode <= POWER_OFF; mode++)
+    {   power = mode;
+        CCP2CON = 0b00000010;
+        for (n = 0; n < 16; n++)    // (into step)
+        {   signal_gate();  }
+        on = edges = 0;
+        for (n = 0; n < 4 * 16; n++)
+        {   was = CCP2CON;
+            signal_gate();
+            if (CCP2CON != 0)
+            {   ++on;   }
+            else if (LATC1 != 0)
+            {   printf("FAIL: power %u: LED's off, but RC1 left high\n", mode);
+                ++fail;
+            }
+            if (was != 0 && CCP2CON == 0)
+            {   ++edges;    }
+        }
+        printf("  power %u: LED's driven %2u of 64 calls, turned off %u times\n",
+               mode, on, edges);
+        if (on != 4 * ON[mode] || edges != ((ON[mode] == 16)? 0 : 4))
+        {   printf("FAIL: power %u: LED's driven %u of 64 calls, off %u times\n",
+                   mode, on, edges);
+            ++fail;
+        }
+    }
+}
+
+static void arcs(void)
+/* 'arc()' periods & current, in each mode */
+{
+    static const struct { unsigned int p1, p2; } ARC[] =
+    {   {2300, 2300}, {3840, 7980}, {7980, 3840}, {8160, 8160}
+    };
+    unsigned mode, i;
+    unsigned long p1, p2, m1, m2;
+
+    for (mode = POWER_FULL; mode < POWER_OFF; mode++)
+    {   power = mode;
+        current_trim = (mode == POWER_FULL)? 0x00 : 0x01;
+        for (i = 0; i < sizeof ARC / sizeof ARC[0]; i++)
+        {   arc(1, ARC[i].p1, ARC[i].p2, 0);
+            p1 = ARC[i].p1 + (ARC[i].p1 >> 3) * mode;
+            p2 = ARC[i].p2 + (ARC[i].p2 >> 3) * mode;
+            m1 = PR2 * 32UL;
+            m2 = CCPR4H * 256UL + CCPR4L;
+            // (M1 goes by PR2, in 32 us steps; clamped, M2 keeps the ratio)
+            if ((p1 <= 8160)? (m1 != (p1 & ~31UL) || m2 != p2) :
+                (PR2 != 255 || labs((long)(m2 * p1) - (long)(p2 * 8160)) >
+                               (long)p1))
+            {   printf("FAIL: power %u: arc(%u, %u) ran at %lu, %lu us\n",
+                       mode, ARC[i].p1, ARC[i].p2, m1, m2);
+                ++fail;
+            }
+            if (L0 != (current_trim & 1) || L1 != ((current_trim >> 1) & 1))
+            {   printf("FAIL: power %u: arc() with L0 %u, L1 %u\n",
+                       mode, L0, L1);
+                ++fail;
+            }
+        }
+    }
+}
+
+int main(void)
+{
+    power = POWER_FULL;
+    arcs();
+    duty();
+    power = POWER_FULL;
+    thresholds();
+    if (fail == 0)
+    {   printf("test_power: thresholds, hysteresis, LED duty and arcs as meant\n"); }
+    return fail != 0;
+}
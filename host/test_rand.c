@@ -0,0 +1,127 @@
+/*
+ * File:   test_rand.c  (host build)
+ *
+ * The pseudo-random numbers of MotorControl.c:
+ *  - from any non-zero seed, 'rand_word()' comes back round after exactly
+ *    65535 steps, never giving 0, so it visits every other 16-bit value once
+ *  - 'rand()' spreads RAND_DIRECTION, RAND_MOVE, RAND_DEGREE & RAND_TIME
+ *    evenly over their ranges: from SAMPLES draws per value, the chi-square
+ *    must be no more than 5 standard deviations above what chance gives, and
+ *    no value may come up more than WORST off SAMPLES times. (Draws run
+ *    through whole periods of 'rand_word()', so the counts come out far more
+ *    even than chance would have them: a value that far off is one the
+ *    mapping favours, or neglects.)
+ * and what each call costs, in host CPU cycles (see clock.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "clock.h"
+#include "firmware.h"
+
+#define SAMPLES 1000        // draws per value in the range
+#define WORST   0.05        // the most any value may be off that
+
+static const struct range
+{   const char *name;
+    rand_t      type;
+    unsigned    low, high;
+}   RANGE[] =
+{   {"RAND_DIRECTION", RAND_DIRECTION, 'L',  'R'},
+    {"RAND_MOVE",      RAND_MOVE,        3,    6},
+    {"RAND_DEGREE",    RAND_DEGREE,     80,  207},
+    {"RAND_TIME",      RAND_TIME,     1536, 8191},
+};
+#define RANGES (sizeof(RANGE) / sizeof(RANGE[0]))
+
+static int period(unsigned seed)
+/* 0 if 'rand_word()' doesn't come back to 'seed' after 65535 steps, without
+ *  ever giving 0 or 'seed' before that
+ */
+{
+    unsigned long n;
+    unsigned x;
+
+    SHFTREG = seed;
+    for (n = 1; n <= 65535; n++)
+    {   x = rand_word();
+        if (x == 0 || (x == seed) != (n == 65535))
+        {   printf("FAIL: from seed 0x%04X, rand_word() gave 0x%04X at step %lu\n",
+                   seed, x, n);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int flat(const struct range *r, unsigned long long overhead)
+/* 0 if 'rand(r->type)' isn't spread evenly over 'r' */
+{
+    // RAND_DIRECTION gives 'L' or 'R', and nothing between
+    unsigned       values = (r->type == RAND_DIRECTION)? 2 : r->high - r->low + 1;
+    unsigned long *count = calloc(values, sizeof *count);
+    unsigned long  n, draws = (unsigned long)values * SAMPLES;
+    unsigned long long t0, t1, cost = 0;
+    unsigned       x, i;
+    double         chi2 = 0, dof = values - 1, d, worst = 0;
+
+    for (n = 0; n < draws; n++)
+    {   t0 = clock_now();
+        x = rand(r->type);
+        t1 = clock_now();
+        cost += t1 - t0 - overhead;
+
+        if (r->type == RAND_DIRECTION)
+        {   i = (x == 'L')? 0 : (x == 'R')? 1 : values;   }
+        else
+        {   i = x - r->low;     }   // (out of range: wraps round, too big)
+        if (i >= values)
+        {   printf("FAIL: %s gave %u\n", r->name, x);
+            free(count);
+            return 0;
+        }
+        ++count[i];
+    }
+    for (i = 0; i < values; i++)
+    {   d = (double)count[i] - SAMPLES;
+        chi2 += d * d / SAMPLES;
+        if (fabs(d) > worst)
+        {   worst = fabs(d);    }
+    }
+    free(count);
+
+    printf("  %-14s %4u values: chi-square %8.1f (%u dof), worst %4.1f%% off, "
+           "%5.1f %s a call\n", r->name, values, chi2, values - 1,
+           100 * worst / SAMPLES, (double)cost / draws, UNIT);
+    if (chi2 - dof > 5 * sqrt(2 * dof) || worst > WORST * SAMPLES)
+    {   printf("FAIL: %s isn't flat\n", r->name);
+        return 0;
+    }
+    return 1;
+}
+
+int main(void)
+{
+    static const unsigned SEED[] = {0x0001, 0x00FF, 0x8000, 0xACE1, 0xFFFF};
+    unsigned long long overhead = clock_overhead(), t0, t1;
+    unsigned i;
+    int ok = 1;
+
+    for (i = 0; i < sizeof SEED / sizeof SEED[0]; i++)
+    {   ok &= period(SEED[i]);  }
+    if (ok)
+    {   printf("test_rand: rand_word() has period 65535 from %u seeds\n", i);  }
+
+    SHFTREG = 0xACE1;
+    t0 = clock_now();
+    for (i = 0; i < 65535; i++)
+    {   rand_word();    }
+    t1 = clock_now();
+    printf("  %-14s %5.1f %s a call\n", "rand_word()",
+           (double)(t1 - t0 - overhead) / 65535, UNIT);
+
+    for (i = 0; i < RANGES; i++)
+    {   ok &= flat(&RANGE[i], overhead);    }
+    return !ok;
+}
@@ -0,0 +1,113 @@
+/*
+ * File:   test_react.c  (host build)
+ *
+ * 'state_event()' (MainFunctions.c) against the switch on STATE it replaced:
+ *  every one of the 8192 STATEs (13 event flags) is resolved, and each one the
+ *  old switch had a case for must still get the same kind of reaction (front
+ *  or rear collision, wheel stuck, 'done', or "hanging state") pivoting the
+ *  same way (see 'react()': right, left, or at random).
+ * The one difference meant is 98 (PB1 with LDR4 & PB3): the old switch
+ *  reacted to the rear, where a front signal now outranks any rear one.
+ *  The STATEs the old switch ignored are counted, by what they get now.
+ */
+
+#include <stdio.h>
+#include "firmware.h"
+
+enum kind { NONE, DONE, HANG, FRONT, REAR, WHEEL, KINDS };
+static const char *const KIND[KINDS] =
+{   "nothing", "done", "hanging", "front", "rear", "wheel"
+};
+
+// the old switch: each event reacted to, and the STATEs it was reacted to for
+//  (0 ends each list)
+static const struct old
+{   enum kind    kind;
+    unsigned int event;
+    unsigned int state[36];
+}   OLD[] =
+{   {FRONT,    1, {1, 0}},
+    {FRONT,    2, {2, 3, 5, 6, 7, 23, 0}},
+    {FRONT,    4, {4, 21, 0}},
+    {FRONT,    8, {8, 12, 20, 24, 28, 29, 0}},
+    {FRONT,   16, {16, 0}},
+    {REAR,    32, {32, 0}},
+    {REAR,    64, {64, 98, 160, 192, 224, 736, 0}},
+    {REAR,   128, {128, 672, 0}},
+    {REAR,   256, {256, 384, 640, 768, 896, 928, 0}},
+    {REAR,   512, {512, 0}},
+    {WHEEL, 1024, {1024, 2048, 3072, 0}},
+    {DONE,     0, {4096, 0}},
+    {HANG,     0, {4097, 4098, 4099, 4100, 4101, 4102, 4103, 4104, 4119,
+                   4117, 4108, 4116, 4120, 4124, 4125, 4112, 4128, 4160,
+                   4194, 4256, 4288, 4320, 4832, 4224, 4768, 4352, 4480,
+                   4736, 4864, 4992, 5024, 4608, 5120, 6144, 7168, 0}},
+};
+#define OLDS (sizeof(OLD) / sizeof(OLD[0]))
+
+#define MEANT 98        // the one STATE meant to react differently
+
+static char direction(unsigned int event)
+/* which way 'react()' pivots after 'event' ('?': at random) */
+{
+    if (event == 16 || event == 512)
+    {   return 'R'; }
+    if (event == 1 || event == 32)
+    {   return 'L'; }
+    return '?';
+}
+
+static enum kind kind(unsigned int event)
+/* the kind of reaction 'state_event()' gave 'event' for */
+{
+    if (event == REACT_HANG)        return HANG;
+    if (event == REACT_DONE)        return DONE;
+    if ((event & STATE_REAR) != 0)  return REAR;
+    if (event == 1024)              return WHEEL;
+    if (event != 0)                 return FRONT;
+    return NONE;
+}
+
+int main(void)
+{
+    static struct old const *was[8192];
+    unsigned int state, event, n;
+    unsigned long cases = 0, same = 0, differ = 0, fail = 0, added[KINDS] = {0};
+    const struct old *o;
+    int k;
+
+    for (o = OLD; o < OLD + OLDS; o++)
+    {   for (n = 0; o->state[n] != 0; n++)
+        {   was[o->state[n]] = o;   }
+    }
+
+    for (state = 0; state < 8192; state++)
+    {   event = state_event(state);
+        k = kind(event);
+        if ((o = was[state]) == NULL)
+        {   ++added[k];
+            continue;
+        }
+        ++cases;
+        if (k == (int)o->kind && direction(event) == direction(o->event))
+        {   ++same;
+            if (state == MEANT)
+            {   printf("FAIL: STATE %u reacts as it used to\n", state);
+                ++fail;
+            }
+            continue;
+        }
+        ++differ;
+        printf("%s: STATE %u was %s %u (%c), now %s %u (%c)\n",
+               (state == MEANT)? "meant" : "FAIL", state, KIND[o->kind],
+               o->event, direction(o->event), KIND[k], event, direction(event));
+        if (state != MEANT)
+        {   ++fail; }
+    }
+
+    printf("test_react: %lu old cases, %lu the same, %lu different; of the "
+           "%lu STATEs ignored before,", cases, same, differ, 8192 - cases);
+    for (k = 0; k < KINDS; k++)
+    {   printf(" %lu %s%s", added[k], KIND[k], (k < KINDS - 1)? "," : "\n");  }
+    return fail != 0;
+}
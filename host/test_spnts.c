@@ -0,0 +1,137 @@
+/*
+ * File:   test_spnts.c  (host build)
+ *
+ * The packed history of 'signal()' (the 'GRDNT' bit planes, 'LDRSIG' last &
+ *  held) against the 21 entry queues it replaced (see baseline.c): every
+ *  module is fed the same samples as both baseline versions, a stretch of
+ *  each kind of input at a time, and LDRx & WHEELx must agree after every
+ *  one of them. The wheel modules run through each stretch with 'bb' at
+ *  several points in a movement, so the stall test is both live and not.
+ * Fails on the first difference; otherwise says how many detections the
+ *  samples gave rise to (so that the agreement means something).
+ *
+ *  test_spnts [seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "firmware.h"
+#include "baseline.h"
+
+#define STRETCH 600     // samples of each kind...
+#define QUIET   60      //  ...the last of them steady, for LDRx to go off
+
+static unsigned short *const LDR[8] =
+{   &LDR1, &LDR2, &LDR3, &LDR4, &LDR5, &LDR6, &LDR7, &LDR8
+};
+
+static unsigned long seed = 1;
+
+static int noise(int size)
+/* -size to +size */
+{
+    seed = seed * 1103515245 + 12345;
+    return (size == 0)? 0 : (int)((seed >> 16) % (2 * size + 1)) - size;
+}
+
+static long value(int kind, int module, long n)
+/* the 'n'th sample of a stretch of input of kind 'kind' */
+{
+    int period;
+
+    switch (kind)
+    {   case 0:  return 500;                                    // steady
+        case 1:  return 500 + noise(1);                         // quiet
+        case 2:  return 500 + noise(8);                         // noisy
+        case 3:  return 300 + n;                                // ramp up
+        case 4:  return 900 - n;                                //  ...down
+        case 5:  return (n % 97 == 0)? 1023 : 500 + noise(2);   // spikes
+        case 18: return 500 + noise(60);                        // very noisy
+        default: break;             // (last, as it lifts the noise floor so)
+    }
+    // triangle & sine waves, about the periods the detectors look for and
+    //  either side of them
+    if (kind < 12)
+    {   period = 30 + 4 * (kind - 6) + module;
+        return 500 + (10 + 12 * (kind - 6)) * labs(n % period - period / 2) /
+               (period / 2) + noise(2);
+    }
+    period = 8 + 6 * (kind - 12) + module;
+    return 500 + (long)lround((10 * (kind - 11)) * sin(2 * M_PI * n / period)) +
+           noise(kind - 12);
+}
+#define KINDS 19
+
+int main(int argc, char **argv)
+{
+    static const unsigned int BB[] = {0, 40, 126, 127, 1000, 40000};
+    unsigned short v;
+    unsigned long samples = 0, detections[8] = {0};
+    unsigned short was[8];
+    int kind, b, m, i;
+    long n, x;
+
+    if (argc > 1)
+    {   seed = strtoul(argv[1], NULL, 10);  }
+
+    TMR1IF = 1;
+    start_signal();
+    baseline_reset();
+    for (m = 0; m < 8; m++)
+    {   was[m] = *LDR[m];   }
+
+    for (b = 0; b < (int)(sizeof BB / sizeof BB[0]); b++)
+    {   bb = BB[b];
+        for (kind = 0; kind < KINDS; kind++)
+        {   for (n = 0; n < STRETCH; n++)
+            {   for (m = 1; m <= 8; m++)
+                {   // (the collision detectors only need the one pass)
+                    if (m <= 6 && b != 0)
+                    {   continue;   }
+                    x = (n < STRETCH - QUIET)? value(kind, m, n) : 500;
+                    v = (unsigned short)((x < 0)? 0 : (x > 1023)? 1023 : x);
+
+                    baseline_sample(m, v, 1);
+                    baseline_sample(m, v, 0);
+                    host_adc_convert(m, v);
+                    signal(m);
+                    ++samples;
+
+                    for (i = 0; i < 2; i++)
+                    {   if (*LDR[m - 1] != BASELINE_LDR[i][m - 1] ||
+                            (m == 7 && WHEEL7 != BASELINE_WHEEL[i][6]) ||
+                            (m == 8 && WHEEL8 != BASELINE_WHEEL[i][7]))
+                        {   printf("FAIL: module %d, input kind %d, sample %ld, "
+                                   "bb %u: LDR%d %u WHEEL %u, %s %u %u\n",
+                                   m, kind, n, BB[b], m, *LDR[m - 1],
+                                   (m == 7)? WHEEL7 : (m == 8)? WHEEL8 : 0,
+                                   (i == 1)? "summing" : "SLOPE",
+                                   BASELINE_LDR[i][m - 1],
+                                   BASELINE_WHEEL[i][m - 1]);
+                            return 1;
+                        }
+                    }
+                    // a detection: LDRx comes on (modules 1-6), or the wheel
+                    //  is seen to stall (7 & 8)
+                    if ((m <= 6)? (was[m - 1] == 0 && *LDR[m - 1] != 0) :
+                                  (was[m - 1] != 0 && *LDR[m - 1] == 0))
+                    {   ++detections[m - 1];    }
+                    was[m - 1] = *LDR[m - 1];
+                }
+            }
+        }
+    }
+
+    printf("test_spnts: %lu samples agree; detections", samples);
+    for (m = 0; m < 8; m++)
+    {   printf(" %lu", detections[m]);  }
+    printf("\n");
+    for (m = 0; m < 8; m++)
+    {   if (detections[m] == 0)
+        {   printf("FAIL: nothing detected by module %d\n", m + 1);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * File:   xc.h  (host build)
+ *
+ * Stands in for XC8's <xc.h> when the firmware is built on a PC (see
+ *  Makefile): every special function register the firmware touches is a
+ *  plain variable (see sfr.c), and the XC8 keywords mean nothing. The ADC
+ *  itself is replaced by a replay of recorded or synthetic traces (adc.h).
+ *
+ * The firmware sources include this as <xc.h>, after int16.h; host code
+ *  includes firmware.h instead, after its system headers.
+ */
+
+#ifndef HOST_XC_H
+#define HOST_XC_H
+
+// XC8 keywords
+typedef unsigned char bit;
+#define interrupt
+#define high_priority
+#define low_priority
+#define __at(address)
+#define __delay_ms(x)   ((void)0)
+#define __delay_us(x)   ((void)0)
+#define SLEEP()         ((void)0)
+
+// names the C library has taken already
+#define signal  ldr_signal
+#define rand    beetle_rand
+
+// 8-bit registers
+extern volatile unsigned char
+    ADCON1, ADCON2, ADRESH, ADRESL,
+    ANSELA, ANSELB, ANSELC, TRISA, TRISB, TRISC, LATB, PORTB,
+    OSCCON, PMD0, PMD1, PMD2,
+    T0CON, T1CON, T2CON, T3CON, T4CON, T5CON, PR2, PR4,
+    TMR0L, TMR1L, TMR1H, TMR3L, TMR3H, TMR5L, TMR5H,
+    CCPTMRS0, CCP2CON, CCP4CON, CCP5CON,
+    CCPR2L, CCPR2H, CCPR4L, CCPR4H, CCPR5L, CCPR5H;
+
+// registers the firmware also reaches bit by bit
+typedef union
+{   unsigned char byte;
+    struct
+    {   unsigned b0 : 1, b1 : 1, b2 : 1, b3 : 1, b4 : 1, b5 : 1, b6 : 1, b7 : 1;
+    };
+} host_port_t;
+extern volatile host_port_t host_LATA, host_LATC;
+#define LATA    host_LATA.byte
+#define LA0     host_LATA.b0
+#define LA1     host_LATA.b1
+#define LA2     host_LATA.b2
+#define LA3     host_LATA.b3
+#define LA4     host_LATA.b4
+#define LA5     host_LATA.b5
+#define LA6     host_LATA.b6
+#define LA7     host_LATA.b7
+#define LATC    host_LATC.byte
+#define LATC0   host_LATC.b0
+#define LATC1   host_LATC.b1
+#define PORTCbits host_PORTCbits
+typedef struct { unsigned RC1 : 1; } host_PORTCbits_t;
+extern volatile host_PORTCbits_t host_PORTCbits;
+#define ADCON0bits host_ADCON0bits
+typedef struct { unsigned GO_nDONE : 1, CHS : 5; } host_ADCON0bits_t;
+extern volatile host_ADCON0bits_t host_ADCON0bits;
+#define CCPTMRS1bits host_CCPTMRS1bits
+typedef struct { unsigned C4TSEL : 2, C5TSEL : 2; } host_CCPTMRS1bits_t;
+extern volatile host_CCPTMRS1bits_t host_CCPTMRS1bits;
+
+// single bits
+extern volatile unsigned char
+    GIEH, GIEL, IPEN, PLLEN, TRISC1, ADON, GO_nDONE, ADIE, ADIF,
+    TMR0IE, TMR0IF, TMR1IF, TMR2IE, TMR2IF, TMR2IP, TMR2ON, TMR3ON,
+    TMR4IE, TMR4IF, TMR5IF, TMR5ON, CCP4IE, CCP4IF, CCP5IE, CCP5IF;
+
+#include "adc.h"
+
+#endif  /* HOST_XC_H */